@@ -0,0 +1,67 @@
+-- decoder for the threat-map overlay updates that XAI sends
+-- (when built with LUA_THREATMAP_DEBUG) as a binary message
+-- following an "[AI::XAI::ThreatMap::Delta]" message; meant
+-- to be included by the gadget that receives the AI calls
+--
+-- message layout (varints are unsigned LEB128):
+--   byte     protocol version (1)
+--   byte     scale exponent e
+--   runs of  varint skip   (cells since the end of the previous run)
+--            varint count  (cells in this run)
+--            count bytes   (new cell values, as fractions of 255)
+--
+-- a cell's absolute threat is (byte / 255) * 2^e, the overlay
+-- stores byte / 255 and the scale as "threatMapScale"
+
+local strbyte = string.byte
+
+local function ReadVarInt(msg, pos)
+	local val = 0
+	local mul = 1
+
+	while (true) do
+		local b = strbyte(msg, pos)
+		pos = pos + 1
+
+		if (b < 128) then
+			return (val + b * mul), pos
+		end
+
+		val = val + (b - 128) * mul
+		mul = mul * 128
+	end
+end
+
+-- patches <threatMap> (normally GG.AIThreatMap) in place
+-- and returns the number of cells that were written, or
+-- -1 if the message has an unknown version
+function DecodeThreatMapDelta(msg, threatMap)
+	if (strbyte(msg, 1) ~= 1) then
+		return -1
+	end
+
+	threatMap["threatMapScale"] = 2 ^ strbyte(msg, 2)
+
+	local len = #msg
+	local pos = 3
+	local idx = 0
+	local num = 0
+
+	while (pos <= len) do
+		local skip, count
+
+		skip, pos = ReadVarInt(msg, pos)
+		count, pos = ReadVarInt(msg, pos)
+		idx = idx + skip
+
+		for i = 0, (count - 1) do
+			threatMap[idx + i] = strbyte(msg, pos + i) / 255
+		end
+
+		pos = pos + count
+		idx = idx + count
+		num = num + count
+	end
+
+	return num
+end
@@ -13,6 +13,8 @@
 #include "../commands/XAICommandTracker.hpp"
 #include "../events/XAIIEvent.hpp"
 #include "../events/XAIEventHandler.hpp"
+#include "../map/XAIThreatMap.hpp"
+#include "../path/XAIPathFinder.hpp"
 #include "../units/XAIUnitDefHandler.hpp"
 
 unsigned int XAI::xaiInstances = 0;
@@ -214,6 +216,23 @@ void XAI::EnemyDestroyed(int enemyUnitID, int attackerUnitID) {
 
 
 void XAI::GotChatMessage(const char* msg, int playerNum) {
+	// ".xai selfcheck" runs the self-checks of the map
+	// layers and logs their results
+	if (std::string(msg) != ".xai selfcheck") {
+		return;
+	}
+
+	XAI_BEG_EXCEPTION
+		XAICScopedTimer t("[XAI::GotChatMessage::SelfCheck]", xaiHelper->timer);
+
+		int numErrors = 0;
+		numErrors += xaiHelper->threatMap->SelfCheck();
+		numErrors += xaiHelper->pathFinder->SelfCheck();
+
+		std::stringstream msgStream;
+			msgStream << "[XAI] self-check found " << numErrors << " error(s), see the log";
+		xaiHelper->rcb->SendTextMsg(msgStream.str().c_str(), 0);
+	XAI_END_EXCEPTION(xaiHelper->logger, "[XAI::GotChatMessage]")
 }
 void XAI::GotLuaMessage(const char* inData, const char** outData) {
 }
@@ -6,5 +6,6 @@
 #define XAI_LOG_DIR   std::string(XAI_ROOT_DIR) + "logs/"
 #define XAI_CFG_DIR   std::string(XAI_ROOT_DIR) + "cfgs/"
 #define XAI_MTL_DIR   std::string(XAI_ROOT_DIR) + "mtl/"
+#define XAI_MSK_DIR   std::string(XAI_ROOT_DIR) + "masks/"
 
 #endif
@@ -23,6 +23,7 @@
 #include "../tasks/XAITaskListsParser.hpp"
 #include "../groups/XAIGroupHandler.hpp"
 #include "../trackers/XAIIStateTracker.hpp"
+#include "../trackers/XAIEnemySnapshot.hpp"
 #include "../path/XAIPathFinder.hpp"
 #include "../map/XAIThreatMap.hpp"
 
@@ -48,6 +49,7 @@ void XAIHelper::Init(IGlobalAICallback* gcb) {
 	milTaskHandler  = new XAICMilitaryTaskHandler(this);
 	groupHandler    = new XAICGroupHandler(this);
 	stateTracker    = new XAICStateTracker(this);
+	enemySnapshot   = new XAICEnemySnapshot(this);
 	pathFinder      = new XAICPathFinder(this);
 	threatMap       = new XAIThreatMap(this);
 	taskListsParser = new XAITaskListsParser();
@@ -55,7 +57,9 @@ void XAIHelper::Init(IGlobalAICallback* gcb) {
 	irng = new RNGint32(); irng->seedGen(time(NULL));
 	frng = new RNGflt64(); frng->seedGen((*irng)());
 
-	eventHandler->AddReceiver(threatMap,        0);
+	eventHandler->AddReceiver(enemySnapshot,    0);
+	eventHandler->AddReceiver(threatMap,        1);
+	eventHandler->AddReceiver(pathFinder,       2);
 	eventHandler->AddReceiver(unitHandler,      4);
 	eventHandler->AddReceiver(groupHandler,     5);
 	eventHandler->AddReceiver(stateTracker,    10);
@@ -131,6 +135,7 @@ void XAIHelper::Release() {
 	delete milTaskHandler;  milTaskHandler  = NULL;
 	delete groupHandler;    groupHandler    = NULL;
 	delete stateTracker;    stateTracker    = NULL;
+	delete enemySnapshot;   enemySnapshot   = NULL;
 	delete pathFinder;      pathFinder      = NULL;
 	delete threatMap;       threatMap       = NULL;
 	delete taskListsParser; taskListsParser = NULL;
@@ -17,6 +17,7 @@ class XAICUnitDGunControllerHandler;
 class XAIITaskHandler;
 class XAICGroupHandler;
 class XAICStateTracker;
+class XAICEnemySnapshot;
 class XAICPathFinder;
 struct XAIThreatMap;
 struct XAITaskListsParser;
@@ -47,6 +48,7 @@ public:
 		milTaskHandler = NULL;
 		groupHandler   = NULL;
 		stateTracker   = NULL;
+		enemySnapshot  = NULL;
 		pathFinder     = NULL;
 		threatMap      = NULL;
 
@@ -86,6 +88,7 @@ public:
 	XAIITaskHandler*               milTaskHandler;
 	XAICGroupHandler*              groupHandler;
 	XAICStateTracker*              stateTracker;
+	XAICEnemySnapshot*             enemySnapshot;
 	XAICPathFinder*                pathFinder;
 	XAIThreatMap*                  threatMap;
 	XAITaskListsParser*            taskListsParser;
@@ -1,7 +1,7 @@
 #ifndef XAI_MAP_HDR
 #define XAI_MAP_HDR
 
-#include <list>
+#include <algorithm>
 #include <vector>
 #include "../main/XAIConstants.hpp"
 
@@ -15,83 +15,96 @@ enum XAIMapType {
 
 
 
-template<typename T> struct XAIMapPixel {
+// half-open rectangle [xmin, xmax) x [zmin, zmax) of map pixels
+struct XAIMapRect {
 public:
-	XAIMapPixel(): x(-1), y(-1), v(T(0)) {}
-	XAIMapPixel(int xp, int yp, T val): x(xp), y(yp), v(val) {}
+	XAIMapRect(): xmin(0), zmin(0), xmax(0), zmax(0) {
+	}
+	XAIMapRect(int x0, int z0, int x1, int z1): xmin(x0), zmin(z0), xmax(x1), zmax(z1) {
+	}
 
-	int GetX() const { return x; }
-	int GetY() const { return y; }
-	T GetValue() const { return v; }
-	void SetX(int nx) { x = nx; }
-	void SetY(int ny) { y = ny; }
-	void SetValue(T nv) { v = nv; }
+	void ClipTo(int sx, int sz) {
+		xmin = std::max(xmin, 0); xmax = std::min(xmax, sx);
+		zmin = std::max(zmin, 0); zmax = std::min(zmax, sz);
+	}
 
-	XAIMapPixel<T>& operator += (T s) { v += s; return *this; }
-	XAIMapPixel<T>& operator *= (T s) { v *= s; return *this; }
-	XAIMapPixel<T>& operator /= (T s) { v /= s; return *this; }
+	bool IsEmpty() const { return (xmin >= xmax || zmin >= zmax); }
+	int GetArea() const { return (IsEmpty()? 0: ((xmax - xmin) * (zmax - zmin))); }
 
-private:
-	// coordinates
-	int x, y;
+	int xmin, zmin;
+	int xmax, zmax;
+};
+
+
+
+template<typename T> struct XAIMap;
 
-	// value
-	T v;
+// read-only proxy for a single map pixel; maps only
+// store values, so coordinates are derived from the
+// pixel's index (out-of-bounds pixels have index -1
+// and coordinates (-1, -1))
+template<typename T> struct XAIMapPixel {
+public:
+	XAIMapPixel(): map(0), idx(-1) {}
+	XAIMapPixel(const XAIMap<T>* m, int i): map(m), idx(i) {}
+
+	int GetIndex() const { return idx; }
+	int GetX() const { return ((idx >= 0)? (idx % map->GetSizeX()): -1); }
+	int GetY() const { return ((idx >= 0)? (idx / map->GetSizeX()): -1); }
+	T GetValue() const { return ((idx >= 0)? map->GetValue(idx): T(0)); }
+
+private:
+	const XAIMap<T>* map;
+	int idx;
 };
 
 
 
+// dense row-major map of values; pixel (x, y)
+// is stored at index (y * GetSizeX() + x)
 template<typename T> struct XAIMap {
 public:
 	XAIMap(int sx, int sy, T v, XAIMapType t): type(t), mapx(sx), mapy(sy) {
-		pixels.resize(sx * sy, XAIMapPixel<T>(-1, -1, v));
+		values.resize(sx * sy, v);
 	}
 	~XAIMap() {
-		pixels.clear();
+		values.clear();
 	}
 
 	void Copy(const T* map) {
-		for (int idx = (mapx * mapy) - 1; idx >= 0; idx--) {
-			pixels[idx] = XAIMapPixel<T>((idx % mapx), (idx / mapx), map[idx]);
-		}
+		std::copy(map, map + (mapx * mapy), values.begin());
+	}
+	void Fill(T v) {
+		std::fill(values.begin(), values.end(), v);
 	}
 
-	// bool InBounds(int x, int y) const { return ((x >= 0 && x < mapx) && (y >= 0 && y < mapy)); }
 	bool InBounds(int idx) const { return (idx >= 0 && idx < (mapx * mapy)); }
-	bool InBounds(int x, int y) const { return (InBounds(y * mapx + x)); }
-	bool InBounds(const XAIMapPixel<T>* p) const { return (InBounds(p->GetX(), p->GetY())); }
+	bool InBounds(int x, int y) const { return ((x >= 0 && x < mapx) && (y >= 0 && y < mapy)); }
 
 	XAIMapType GetType() const { return type; }
 	int GetSizeX() const { return mapx; }
 	int GetSizeY() const { return mapy; }
+	int GetArea() const { return (mapx * mapy); }
 
 
-	// these are non-const, so caller may change pixel values
-	XAIMapPixel<T>* GetPixel(int idx) {
-		static XAIMapPixel<T> pxl(-1, -1, T(0));
+	// out-of-bounds reads return T(0)
+	T GetValue(int idx) const { return (InBounds(idx)? values[idx]: T(0)); }
+	T GetValue(int x, int y) const { return (InBounds(x, y)? values[y * mapx + x]: T(0)); }
 
-		if (InBounds(idx)) {
-			return (&pixels[idx]);
-		} else {
-			return (&pxl);
-		}
-	}
-	XAIMapPixel<T>* GetPixel(int x, int y) {
-		return (GetPixel(y * mapx + x));
-	}
+	// caller does the bounds-check
+	void SetValue(int idx, T v) { values[idx] = v; }
+	void SetValue(int x, int y, T v) { values[y * mapx + x] = v; }
 
-	// these are const, so caller may not set pixel values
-	const XAIMapPixel<T>* GetConstPixel(int idx) const {
-		static const XAIMapPixel<T> pxl(-1, -1, T(0));
+	T* GetData() { return (&values[0]); }
+	T* GetRow(int y) { return (&values[y * mapx]); }
+	const T* GetData() const { return (&values[0]); }
+	const T* GetRow(int y) const { return (&values[y * mapx]); }
 
-		if (InBounds(idx)) {
-			return (&pixels[idx]);
-		} else {
-			return (&pxl);
-		}
+	XAIMapPixel<T> GetPixel(int idx) const {
+		return (XAIMapPixel<T>(this, (InBounds(idx)? idx: -1)));
 	}
-	const XAIMapPixel<T>* GetConstPixel(int x, int y) const {
-		return (GetConstPixel(y * mapx + x));
+	XAIMapPixel<T> GetPixel(int x, int y) const {
+		return (XAIMapPixel<T>(this, (InBounds(x, y)? (y * mapx + x): -1)));
 	}
 
 protected:
@@ -100,7 +113,7 @@ protected:
 	int mapx;
 	int mapy;
 
-	std::vector<XAIMapPixel<T> > pixels;
+	std::vector<T> values;
 };
 
 #endif
@@ -0,0 +1,328 @@
+#ifndef XAI_MAPPYRAMID_HDR
+#define XAI_MAPPYRAMID_HDR
+
+#include <algorithm>
+#include <vector>
+
+#include "./XAIMap.hpp"
+
+// number of the level whose tiles are marked dirty by
+// MarkDirty (tiles of 8x8 map pixels); finer levels are
+// rebuilt as part of each dirty tile's subtree
+#define MAPPYRAMID_DIRTY_LEVEL 3
+
+// mip-pyramid over an XAIMap<T> that stores the maximum
+// and the sum of the (zero-clamped, ie. negative values
+// count as zero) pixel values per tile at every level;
+// level L has tiles of (2^L)x(2^L) pixels and level 0
+// is the map itself, so that queries can skip entire
+// tiles that are either cold or completely inside the
+// queried rectangle
+//
+// stamps into the map only need to mark their bounding
+// rectangle as dirty, the affected tiles are rebuilt by
+// the next query (or explicit call to Update)
+template<typename T> struct XAIMapPyramid {
+public:
+	XAIMapPyramid(): map(0), numLevels(0), dirtyLevel(0), allDirty(true) {}
+
+	void Init(const XAIMap<T>* m) {
+		map = m;
+
+		const int sx = map->GetSizeX();
+		const int sy = map->GetSizeY();
+
+		numLevels = 1;
+
+		while (((sx - 1) >> (numLevels - 1)) > 0 || ((sy - 1) >> (numLevels - 1)) > 0) {
+			numLevels += 1;
+		}
+
+		levels.clear();
+		levels.resize(numLevels);
+
+		for (int L = 1; L < numLevels; L++) {
+			Level& lvl = levels[L];
+
+			lvl.sizex = ((sx - 1) >> L) + 1;
+			lvl.sizey = ((sy - 1) >> L) + 1;
+			lvl.maxs.resize(lvl.sizex * lvl.sizey, T(0));
+			lvl.sums.resize(lvl.sizex * lvl.sizey, T(0));
+			lvl.dirty.resize(lvl.sizex * lvl.sizey, 0);
+		}
+
+		dirtyLevel = std::min(MAPPYRAMID_DIRTY_LEVEL, numLevels - 1);
+		allDirty = true;
+	}
+
+	void MarkAllDirty() { allDirty = true; }
+	void MarkDirty(const XAIMapRect& rect) {
+		if (allDirty || dirtyLevel == 0)
+			return;
+
+		XAIMapRect r = rect;
+		r.ClipTo(map->GetSizeX(), map->GetSizeY());
+
+		if (r.IsEmpty())
+			return;
+
+		Level& lvl = levels[dirtyLevel];
+
+		for (int ty = (r.zmin >> dirtyLevel); ty <= ((r.zmax - 1) >> dirtyLevel); ty++) {
+			for (int tx = (r.xmin >> dirtyLevel); tx <= ((r.xmax - 1) >> dirtyLevel); tx++) {
+				MarkTile(lvl, ty * lvl.sizex + tx);
+			}
+		}
+	}
+
+	// rebuilds the dirty tiles (if any)
+	void Update() {
+		if (numLevels <= 1)
+			return;
+
+		if (allDirty) {
+			for (int L = 1; L < numLevels; L++) {
+				Level& lvl = levels[L];
+
+				for (int ty = 0; ty < lvl.sizey; ty++) {
+					for (int tx = 0; tx < lvl.sizex; tx++) {
+						BuildTile(L, tx, ty);
+					}
+				}
+
+				std::fill(lvl.dirty.begin(), lvl.dirty.end(), 0);
+				lvl.dirtyTiles.clear();
+			}
+
+			allDirty = false;
+			return;
+		}
+
+		for (int L = dirtyLevel; L < numLevels; L++) {
+			Level& lvl = levels[L];
+
+			for (int i = 0; i < int(lvl.dirtyTiles.size()); i++) {
+				const int tIdx = lvl.dirtyTiles[i];
+				const int tx = tIdx % lvl.sizex;
+				const int ty = tIdx / lvl.sizex;
+
+				if (L == dirtyLevel) {
+					BuildSubTree(L, tx, ty);
+				} else {
+					BuildTile(L, tx, ty);
+				}
+
+				lvl.dirty[tIdx] = 0;
+
+				if ((L + 1) < numLevels) {
+					Level& parent = levels[L + 1];
+					MarkTile(parent, (ty >> 1) * parent.sizex + (tx >> 1));
+				}
+			}
+
+			lvl.dirtyTiles.clear();
+		}
+	}
+
+	// largest (zero-clamped) value inside a rectangle
+	T GetMax(const XAIMapRect& rect) {
+		XAIMapRect r = rect;
+		r.ClipTo(map->GetSizeX(), map->GetSizeY());
+
+		if (r.IsEmpty())
+			return T(0);
+
+		Update();
+
+		T ret = T(0);
+		GetMaxRec(numLevels - 1, 0, 0, r, ret);
+		return ret;
+	}
+
+	// true if any (zero-clamped) value inside a rectangle exceeds <t>
+	bool AnyAbove(const XAIMapRect& rect, T t) {
+		XAIMapRect r = rect;
+		r.ClipTo(map->GetSizeX(), map->GetSizeY());
+
+		if (r.IsEmpty())
+			return false;
+
+		Update();
+
+		return (AnyAboveRec(numLevels - 1, 0, 0, r, t));
+	}
+
+	// sum of the (zero-clamped) values inside a rectangle
+	T GetSum(const XAIMapRect& rect) {
+		XAIMapRect r = rect;
+		r.ClipTo(map->GetSizeX(), map->GetSizeY());
+
+		if (r.IsEmpty())
+			return T(0);
+
+		Update();
+
+		return (GetSumRec(numLevels - 1, 0, 0, r));
+	}
+
+private:
+	struct Level {
+		Level(): sizex(0), sizey(0) {}
+
+		int sizex;
+		int sizey;
+
+		std::vector<T> maxs;
+		std::vector<T> sums;
+
+		std::vector<unsigned char> dirty;
+		std::vector<int> dirtyTiles;
+	};
+
+	void MarkTile(Level& lvl, int tIdx) {
+		if (lvl.dirty[tIdx] == 0) {
+			lvl.dirty[tIdx] = 1;
+			lvl.dirtyTiles.push_back(tIdx);
+		}
+	}
+
+	T GetPixelValue(int x, int y) const { return std::max(map->GetValue(x, y), T(0)); }
+	T GetTileMax(int L, int tx, int ty) const {
+		if (L == 0)
+			return (GetPixelValue(tx, ty));
+		return (levels[L].maxs[ty * levels[L].sizex + tx]);
+	}
+	T GetTileSum(int L, int tx, int ty) const {
+		if (L == 0)
+			return (GetPixelValue(tx, ty));
+		return (levels[L].sums[ty * levels[L].sizex + tx]);
+	}
+
+	// pixel-space bounds of a tile (clipped to the map)
+	XAIMapRect GetTileRect(int L, int tx, int ty) const {
+		XAIMapRect r(tx << L, ty << L, (tx + 1) << L, (ty + 1) << L);
+		r.ClipTo(map->GetSizeX(), map->GetSizeY());
+		return r;
+	}
+
+	// recomputes a tile from its (up to four) children
+	void BuildTile(int L, int tx, int ty) {
+		const int cxmax = (L == 1)? map->GetSizeX(): levels[L - 1].sizex;
+		const int cymax = (L == 1)? map->GetSizeY(): levels[L - 1].sizey;
+
+		T m = T(0);
+		T s = T(0);
+
+		for (int cy = (ty << 1); cy < std::min((ty << 1) + 2, cymax); cy++) {
+			for (int cx = (tx << 1); cx < std::min((tx << 1) + 2, cxmax); cx++) {
+				m  = std::max(m, GetTileMax(L - 1, cx, cy));
+				s += GetTileSum(L - 1, cx, cy);
+			}
+		}
+
+		levels[L].maxs[ty * levels[L].sizex + tx] = m;
+		levels[L].sums[ty * levels[L].sizex + tx] = s;
+	}
+
+	void BuildSubTree(int L, int tx, int ty) {
+		if (L > 1) {
+			const int cxmax = levels[L - 1].sizex;
+			const int cymax = levels[L - 1].sizey;
+
+			for (int cy = (ty << 1); cy < std::min((ty << 1) + 2, cymax); cy++) {
+				for (int cx = (tx << 1); cx < std::min((tx << 1) + 2, cxmax); cx++) {
+					BuildSubTree(L - 1, cx, cy);
+				}
+			}
+		}
+
+		BuildTile(L, tx, ty);
+	}
+
+	void GetMaxRec(int L, int tx, int ty, const XAIMapRect& r, T& ret) const {
+		const XAIMapRect tr = GetTileRect(L, tx, ty);
+
+		if (tr.xmin >= r.xmax || tr.xmax <= r.xmin || tr.zmin >= r.zmax || tr.zmax <= r.zmin)
+			return;
+		// nothing in this tile can beat the current maximum
+		if (GetTileMax(L, tx, ty) <= ret)
+			return;
+
+		if (L == 0 || (tr.xmin >= r.xmin && tr.xmax <= r.xmax && tr.zmin >= r.zmin && tr.zmax <= r.zmax)) {
+			ret = GetTileMax(L, tx, ty);
+			return;
+		}
+
+		for (int cy = (ty << 1); cy < (ty << 1) + 2; cy++) {
+			for (int cx = (tx << 1); cx < (tx << 1) + 2; cx++) {
+				if (InBounds(L - 1, cx, cy)) {
+					GetMaxRec(L - 1, cx, cy, r, ret);
+				}
+			}
+		}
+	}
+
+	bool AnyAboveRec(int L, int tx, int ty, const XAIMapRect& r, T t) const {
+		const XAIMapRect tr = GetTileRect(L, tx, ty);
+
+		if (tr.xmin >= r.xmax || tr.xmax <= r.xmin || tr.zmin >= r.zmax || tr.zmax <= r.zmin)
+			return false;
+		// a cold tile can be skipped entirely
+		if (GetTileMax(L, tx, ty) <= t)
+			return false;
+
+		if (L == 0 || (tr.xmin >= r.xmin && tr.xmax <= r.xmax && tr.zmin >= r.zmin && tr.zmax <= r.zmax))
+			return true;
+
+		for (int cy = (ty << 1); cy < (ty << 1) + 2; cy++) {
+			for (int cx = (tx << 1); cx < (tx << 1) + 2; cx++) {
+				if (InBounds(L - 1, cx, cy) && AnyAboveRec(L - 1, cx, cy, r, t)) {
+					return true;
+				}
+			}
+		}
+
+		return false;
+	}
+
+	T GetSumRec(int L, int tx, int ty, const XAIMapRect& r) const {
+		const XAIMapRect tr = GetTileRect(L, tx, ty);
+
+		if (tr.xmin >= r.xmax || tr.xmax <= r.xmin || tr.zmin >= r.zmax || tr.zmax <= r.zmin)
+			return T(0);
+		if (GetTileMax(L, tx, ty) <= T(0))
+			return T(0);
+
+		if (L == 0 || (tr.xmin >= r.xmin && tr.xmax <= r.xmax && tr.zmin >= r.zmin && tr.zmax <= r.zmax))
+			return (GetTileSum(L, tx, ty));
+
+		T s = T(0);
+
+		for (int cy = (ty << 1); cy < (ty << 1) + 2; cy++) {
+			for (int cx = (tx << 1); cx < (tx << 1) + 2; cx++) {
+				if (InBounds(L - 1, cx, cy)) {
+					s += GetSumRec(L - 1, cx, cy, r);
+				}
+			}
+		}
+
+		return s;
+	}
+
+	bool InBounds(int L, int tx, int ty) const {
+		if (L == 0)
+			return (map->InBounds(tx, ty));
+		return (tx < levels[L].sizex && ty < levels[L].sizey);
+	}
+
+	const XAIMap<T>* map;
+
+	// levels[0] is unused (the map itself is level 0)
+	std::vector<Level> levels;
+
+	int numLevels;
+	int dirtyLevel;
+	bool allDirty;
+};
+
+#endif
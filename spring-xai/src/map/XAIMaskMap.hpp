@@ -6,22 +6,126 @@
 #include <list>
 #include <vector>
 
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
 #include "Sim/MoveTypes/MoveInfo.h"
 #include "./XAIMap.hpp"
+#include "../utils/XAIUtil.hpp"
+
+// compile-time pixel-filter policies, each tests a single
+// pixel value (and, with SSE, four float values at a time)
+template<typename T> struct XAIPixelPassAll {
+public:
+	bool operator () (T) const { return true; }
+
+	#ifdef __SSE__
+	__m128 operator () (__m128) const { return _mm_cmpeq_ps(_mm_setzero_ps(), _mm_setzero_ps()); }
+	#endif
+};
+
+template<typename T> struct XAIPixelPassBelow {
+public:
+	XAIPixelPassBelow(T v): t(v) {}
+
+	bool operator () (T v) const { return (v < t); }
+
+	#ifdef __SSE__
+	__m128 operator () (__m128 v) const { return _mm_cmplt_ps(v, _mm_set1_ps(t)); }
+	#endif
+
+private:
+	T t;
+};
+
+template<typename T> struct XAIPixelPassAbove {
+public:
+	XAIPixelPassAbove(T v): t(v) {}
+
+	bool operator () (T v) const { return (v > t); }
+
+	#ifdef __SSE__
+	__m128 operator () (__m128 v) const { return _mm_cmpgt_ps(v, _mm_set1_ps(t)); }
+	#endif
+
+private:
+	T t;
+};
+
+// packs the results of policy <p> for (up to) 32 values
+// into one word, bit i being set iff value i passes
+template<typename T, typename P> unsigned int GetPixelPassWord(const T* v, int n, const P& p) {
+	unsigned int word = 0;
+
+	for (int i = 0; i < n; i++) {
+		word |= ((unsigned int) p(v[i])) << i;
+	}
+
+	return word;
+}
+
+#ifdef __SSE__
+template<typename P> unsigned int GetPixelPassWord(const float* v, int n, const P& p) {
+	if (n < 32) {
+		return (GetPixelPassWord<float, P>(v, n, p));
+	}
+
+	unsigned int word = 0;
+
+	for (int i = 0; i < 32; i += 4) {
+		word |= ((unsigned int) _mm_movemask_ps(p(_mm_loadu_ps(v + i)))) << i;
+	}
+
+	return word;
+}
+#endif
+
+// fills the words [w0, w1) of a passable bitplane (bit
+// (i & 31) of bits[i >> 5] is pixel i) for <m> in one
+// pass, with <p> inlined instead of called per pixel
+template<typename T, typename P> void GetPixelPassBits(const XAIMap<T>* m, const P& p, unsigned int* bits, int w0, int w1) {
+	const T* vals = m->GetData();
+	const int area = m->GetArea();
+
+	for (int w = w0; w < w1; w++) {
+		bits[w] = GetPixelPassWord(vals + (w << 5), std::min(32, area - (w << 5)), p);
+	}
+}
+
+
 
 template<typename T> struct XAIIMapPixelFilter {
 public:
-	virtual bool operator () (const XAIMap<T>*, const XAIMapPixel<T>*) {
+	virtual ~XAIIMapPixelFilter() {
+	}
+
+	virtual bool operator () (const XAIMap<T>*, int) {
 		return false;
 	}
+
+	// fills the words [w0, w1) of the passable bitplane for
+	// <m>; by default every pixel goes through operator(),
+	// filters that know their policy override this
+	virtual void GetPassBits(const XAIMap<T>* m, unsigned int* bits, int w0, int w1) {
+		const int area = m->GetArea();
+
+		for (int w = w0; w < w1; w++) {
+			bits[w] = 0;
+
+			for (int i = (w << 5); i < std::min((w + 1) << 5, area); i++) {
+				bits[w] |= ((unsigned int) (*this)(m, i)) << (i & 31);
+			}
+		}
+	}
 };
 
 template<typename T> struct XAIMapPixelLandWaterFilter: public XAIIMapPixelFilter<T> {
 public:
-	bool operator () (const XAIMap<T>* pxlMap, const XAIMapPixel<T>* pxl) {
+	bool operator () (const XAIMap<T>* pxlMap, int pxlIdx) {
 		switch (pxlMap->GetType()) {
 			case XAI_HEIGHT_MAP: {
-				return (pxl->GetValue() > T(0));
+				return (pxlMap->GetValue(pxlIdx) > T(0));
 			} break;
 			default: {
 			} break;
@@ -37,17 +141,19 @@ public:
 	}
 
 	// returns true iif a pixel is traversable wrt. this filter's MoveData
-	bool operator () (const XAIMap<T>* pxlMap, const XAIMapPixel<T>* pxl) {
+	bool operator () (const XAIMap<T>* pxlMap, int pxlIdx) {
+		const T pxlVal = pxlMap->GetValue(pxlIdx);
+
 		switch (pxlMap->GetType()) {
 			case XAI_HEIGHT_MAP: {
-				if (md->moveType == MoveData::Ship_Move  ) { return (pxl->GetValue() < -md->depth); }
-				if (md->moveType == MoveData::Ground_Move) { return (pxl->GetValue() > -md->depth); }
+				if (md->moveType == MoveData::Ship_Move  ) { return (pxlVal < -md->depth); }
+				if (md->moveType == MoveData::Ground_Move) { return (pxlVal > -md->depth); }
 				if (md->moveType == MoveData::Hover_Move ) { return true; }
 			} break;
 			case XAI_SLOPE_MAP: {
 				if (md->moveType == MoveData::Ship_Move  ) { return true; }
-				if (md->moveType == MoveData::Ground_Move) { return (pxl->GetValue() < md->maxSlope); }
-				if (md->moveType == MoveData::Hover_Move ) { return (pxl->GetValue() < md->maxSlope); }
+				if (md->moveType == MoveData::Ground_Move) { return (pxlVal < md->maxSlope); }
+				if (md->moveType == MoveData::Hover_Move ) { return (pxlVal < md->maxSlope); }
 			} break;
 			default: {
 			} break;
@@ -56,17 +162,74 @@ public:
 		return false;
 	}
 
+	// picks the (inlined) policy per layer and moveType once
+	// rather than switching on both for every single pixel
+	void GetPassBits(const XAIMap<T>* pxlMap, unsigned int* bits, int w0, int w1) {
+		switch (pxlMap->GetType()) {
+			case XAI_HEIGHT_MAP: {
+				if (md->moveType == MoveData::Ship_Move  ) { GetPixelPassBits(pxlMap, XAIPixelPassBelow<T>(-md->depth), bits, w0, w1); return; }
+				if (md->moveType == MoveData::Ground_Move) { GetPixelPassBits(pxlMap, XAIPixelPassAbove<T>(-md->depth), bits, w0, w1); return; }
+				if (md->moveType == MoveData::Hover_Move ) { GetPixelPassBits(pxlMap, XAIPixelPassAll<T>(),             bits, w0, w1); return; }
+			} break;
+			case XAI_SLOPE_MAP: {
+				if (md->moveType == MoveData::Ship_Move  ) { GetPixelPassBits(pxlMap, XAIPixelPassAll<T>(),               bits, w0, w1); return; }
+				if (md->moveType == MoveData::Ground_Move) { GetPixelPassBits(pxlMap, XAIPixelPassBelow<T>(md->maxSlope), bits, w0, w1); return; }
+				if (md->moveType == MoveData::Hover_Move ) { GetPixelPassBits(pxlMap, XAIPixelPassBelow<T>(md->maxSlope), bits, w0, w1); return; }
+			} break;
+			default: {
+			} break;
+		}
+
+		XAIIMapPixelFilter<T>::GetPassBits(pxlMap, bits, w0, w1);
+	}
+
 private:
 	const MoveData* md;
 };
 
+// the MoveData parameters that XAIMapPixelHeightSlopeFilter
+// actually reads (with those ignored for a moveType zeroed),
+// so that pathTypes with equal keys can share one mask-map
+struct XAIMoveDataKey {
+public:
+	XAIMoveDataKey(const MoveData* md): moveType(md->moveType), depth(md->depth), maxSlope(md->maxSlope) {
+		if (md->moveType == MoveData::Hover_Move) { depth    = 0.0f; }
+		if (md->moveType == MoveData::Ship_Move ) { maxSlope = 0.0f; }
+	}
+
+	bool operator < (const XAIMoveDataKey& k) const {
+		if (moveType != k.moveType) { return (moveType < k.moveType); }
+		if (depth    != k.depth   ) { return (depth    < k.depth   ); }
+		return (maxSlope < k.maxSlope);
+	}
+
+	// FNV-1a over the canonical parameters
+	unsigned int GetHash() const {
+		unsigned int h = XAI_HASH_SEED;
+
+		h = XAIUtil::HashBytes(h, &moveType, sizeof(moveType));
+		h = XAIUtil::HashBytes(h, &depth,    sizeof(depth   ));
+		h = XAIUtil::HashBytes(h, &maxSlope, sizeof(maxSlope));
+		return h;
+	}
+
+	int   GetMoveType() const { return moveType; }
+	float GetDepth()    const { return depth;    }
+	float GetMaxSlope() const { return maxSlope; }
+
+private:
+	int   moveType;
+	float depth;
+	float maxSlope;
+};
+
 #define APPLY_FILTER(f, m, p) ((*f)(m, p))
 
 
 
 template<typename T> struct XAIMaskMapZone {
 public:
-	typedef std::list<const XAIMapPixel<T>* > MapPixelList;
+	typedef std::list<int> MapPixelList;
 
 	XAIMaskMapZone(): xpos(-1), ypos(-1), size(-1), state(false) {
 	}
@@ -87,8 +250,8 @@ private:
 	int  size;  // total number of pixels in this zone
 	bool state; // true if zone "passed" filter, else false
 
-	// the 8-connected pixels making
-	// up the area of this map zone
+	// indices of the 8-connected pixels
+	// making up the area of this map zone
 	MapPixelList pixels;
 };
 
@@ -96,7 +259,7 @@ private:
 
 template<typename T> struct XAIMaskMap {
 public:
-	typedef std::list<const XAIMapPixel<T>* > MapPixelList; // duplicate
+	typedef std::list<int> MapPixelList; // duplicate
 	typedef std::vector<const XAIMap<T>* > MapVec;
 	typedef std::vector< XAIMap<int>* > MaskVec;
 	typedef std::map<int, XAIMaskMapZone<T> > ZoneMap;
@@ -105,13 +268,20 @@ public:
 	XAIMaskMap(): mpf(0) {
 	}
 	~XAIMaskMap() {
-		for (unsigned int i = 0; i < maps.size(); i++) {
+		FreeMasks();
+		maps.clear();
+	}
+
+	// drops all (possibly partial) masks, so that
+	// they can be generated again from scratch
+	void FreeMasks() {
+		for (unsigned int i = 0; i < masks.size(); i++) {
 			delete masks[i]; zones[i].clear();
 		}
 
-		maps.clear();
 		masks.clear();
 		zones.clear();
+		stepLabeller = LayerLabeller();
 	}
 
 	void AddMap(const XAIMap<T>* map) {
@@ -126,96 +296,328 @@ public:
 	}
 
 	void GenerateMasks() {
-		assert(mpf != NULL);
+		AllocMasks();
 
-		// for each attached map, create a mask-map
 		for (unsigned int i = 0; i < maps.size(); i++) {
-			const XAIMap<T>* pxlMap = maps[i];
-			const int pxlArea = pxlMap->GetSizeX() * pxlMap->GetSizeY();
+			GenerateMask(i);
+		}
+	}
 
-			int pixelsMasked =  0;
-			int zoneMask     = -1;
+	// creates an empty mask-map (all pixels -1) for each
+	// attached map, to be filled in by GenerateMask(i)
+	void AllocMasks() {
+		for (unsigned int i = masks.size(); i < maps.size(); i++) {
+			masks.push_back(new XAIMap<int>(maps[i]->GetSizeX(), maps[i]->GetSizeY(), -1, XAI_MASK_MAP));
+			zones.push_back(ZoneMap());
+		}
+	}
 
-			// initialize the mask-pixels to -1
-			XAIMap<int>* mskMap = new XAIMap<int>(pxlMap->GetSizeX(), pxlMap->GetSizeY(), zoneMask, XAI_MASK_MAP);
+	// labels the mask of the <i>-th attached map; only reads
+	// maps[i] and the filter and only writes masks[i] and
+	// zones[i], so masks can be generated concurrently
+	void GenerateMask(unsigned int i) {
+		LayerLabeller labeller(i);
+		LabelLayer(labeller, -1);
+	}
 
-			masks.push_back(mskMap);
-			zones.push_back(ZoneMap());
+	// resumable variant of GenerateMasks that does roughly
+	// <maxPixels> units of work (one per pixel filtered,
+	// scanned or labelled) per call (a zero budget still
+	// makes progress), returns true once all masks are
+	// complete; produces the same labels
+	bool GenerateMasksStep(int maxPixels) {
+		AllocMasks();
+
+		while (stepLabeller.layer < maps.size()) {
+			if (!LabelLayer(stepLabeller, maxPixels)) {
+				return false;
+			}
 
-			// for each map pixel, find the contiguous
-			// region (aka. "zone") that it is part of
-			for (int idx = pxlArea - 1; idx >= 0; idx--) {
-				const XAIMapPixel<int>* pxl = mskMap->GetConstPixel(idx); 
+			stepLabeller = LayerLabeller(stepLabeller.layer + 1);
+		}
 
-				if (pxl->GetValue() == -1) {
-					const int x = idx % pxlMap->GetSizeX();
-					const int y = idx / pxlMap->GetSizeX();
+		return true;
+	}
 
-					zoneMask += 1;
-					pixelsMasked += FloodFillPixel(pxlMap, mskMap, x, y, zones[zones.size() - 1], zoneMask);
-				}
 
-				if (pixelsMasked == pxlArea) {
-					break;
-				}
+	// restores the mask of the next attached map from the
+	// labels of an earlier GenerateMasks call (eg. loaded
+	// from a cache), zones are not restored
+	void AddMask(const int* labels) {
+		const XAIMap<T>* pxlMap = maps[masks.size()];
+		XAIMap<int>* mskMap = new XAIMap<int>(pxlMap->GetSizeX(), pxlMap->GetSizeY(), -1, XAI_MASK_MAP);
+
+		mskMap->Copy(labels);
+		masks.push_back(mskMap);
+		zones.push_back(ZoneMap());
+	}
+
+	// builds the mask for the <i>-th attached map with the
+	// original per-pixel flood-fill (reference for timing
+	// and verifying GenerateMasks, the caller owns it)
+	XAIMap<int>* GenerateMaskRef(unsigned int i) {
+		assert(mpf != NULL);
+
+		const XAIMap<T>* pxlMap = maps[i];
+		const int pxlArea = pxlMap->GetSizeX() * pxlMap->GetSizeY();
+
+		int pixelsMasked =  0;
+		int zoneMask     = -1;
+
+		XAIMap<int>* mskMap = new XAIMap<int>(pxlMap->GetSizeX(), pxlMap->GetSizeY(), zoneMask, XAI_MASK_MAP);
+		ZoneMap zoneMap;
+
+		for (int idx = pxlArea - 1; idx >= 0; idx--) {
+			if (mskMap->GetValue(idx) == -1) {
+				zoneMask += 1;
+				pixelsMasked += FloodFillPixel(pxlMap, mskMap, idx, zoneMap, zoneMask);
 			}
 
-			assert(pixelsMasked == pxlArea);
+			if (pixelsMasked == pxlArea) {
+				break;
+			}
 		}
+
+		return mskMap;
 	}
 
 protected:
-	void GetNonMaskedNeighbors(const XAIMap<T>* pm, XAIMap<int>* mm, const XAIMapPixel<T>* p, MapPixelList& q) {
+	// state of the (resumable) labelling of one layer
+	struct LayerLabeller {
+		LayerLabeller(unsigned int i = 0): layer(i), filterWord(0), scanIdx(-1), zoneIdx(-1), zoneMask(-1), pixelsMasked(0) {
+		}
+
+		unsigned int layer;
+
+		int filterWord;   // next word of passBits to fill in
+		int scanIdx;      // next pixel to look for a new zone at
+		int zoneIdx;      // first pixel of the zone being filled
+		int zoneMask;     // label of the zone being filled
+		int pixelsMasked; // pixels labelled so far
+
+		std::vector<unsigned int> passBits;
+		std::vector<int> spanStack;
+
+		// pixels of the zone being filled (only collected
+		// if XAI_MASKMAP_DBG, but always declared so that
+		// the layout does not depend on the define)
+		MapPixelList zonePxls;
+	};
+
+	// advances <l> by about <maxPixels> units of work (or
+	// until done if negative, at least one if zero), returns
+	// true once finished
+	bool LabelLayer(LayerLabeller& l, int maxPixels) {
+		assert(mpf != NULL);
+		assert(l.layer < masks.size());
+
+		const XAIMap<T>* pxlMap = maps[l.layer];
+		const int pxlArea = pxlMap->GetSizeX() * pxlMap->GetSizeY();
+
+		XAIMap<int>* mskMap = masks[l.layer];
+
+		const unsigned int budget = (maxPixels < 0)? ~0U: std::max(1U, (unsigned int) maxPixels);
+		unsigned int work = 0;
+
+		const int numWords = (pxlArea + 31) >> 5;
+
+		if (l.passBits.empty() && l.pixelsMasked == 0) {
+			l.passBits.resize(numWords, 0);
+			l.filterWord = 0;
+			l.scanIdx    = pxlArea - 1;
+		}
+
+		// evaluate the filter for all pixels up-front
+		while (l.filterWord < numWords && work < budget) {
+			const unsigned int n = std::min((unsigned int) (numWords - l.filterWord), std::max(1U, (budget - work) >> 5));
+
+			mpf->GetPassBits(pxlMap, &l.passBits[0], l.filterWord, l.filterWord + n);
+
+			l.filterWord += n;
+			work += (n << 5);
+		}
+
+		if (l.filterWord < numWords) {
+			return false;
+		}
+
+		// for each map pixel, find the contiguous
+		// region (aka. "zone") that it is part of
+		//
+		// note: zones are numbered in the order in
+		// which their highest-index pixel is reached
+		while (true) {
+			if (!l.spanStack.empty()) {
+				work += FloodFillSpans(pxlMap, mskMap, l, budget - std::min(work, budget));
+
+				if (!l.spanStack.empty()) {
+					return false;
+				}
+
+				FinishZone(pxlMap, l);
+			}
+
+			if (l.pixelsMasked == pxlArea || l.scanIdx < 0) {
+				break;
+			}
+			if (work >= budget) {
+				return false;
+			}
+
+			if (mskMap->GetValue(l.scanIdx) == -1) {
+				l.zoneMask += 1;
+				l.zoneIdx = l.scanIdx;
+				l.spanStack.push_back(l.scanIdx);
+			}
+
+			l.scanIdx -= 1;
+			work += 1;
+		}
+
+		assert(l.pixelsMasked == pxlArea);
+
+		// release the scratch-space
+		std::vector<unsigned int>().swap(l.passBits);
+		std::vector<int>().swap(l.spanStack);
+		return true;
+	}
+
+	// labels spans of the 8-connected region of equal filter-
+	// state that contains pixel l.zoneIdx, one horizontal span
+	// at a time, until either no spans are left or <maxPixels>
+	// pixels have been labelled; every span pushes at most one
+	// seed per run of fillable pixels in the rows directly
+	// above and below it
+	unsigned int FloodFillSpans(const XAIMap<T>* pxlMap, XAIMap<int>* mskMap, LayerLabeller& l, unsigned int maxPixels) {
+		const int sx = pxlMap->GetSizeX();
+		const int sy = pxlMap->GetSizeY();
+
+		const unsigned int* passBits = &l.passBits[0];
+		const unsigned int b = GetPassBit(passBits, l.zoneIdx);
+
+		int* mskPxls = mskMap->GetData();
+		unsigned int numSpanPxls = 0;
+
+		#define FILLABLE(i) (mskPxls[(i)] == -1 && GetPassBit(passBits, (i)) == b)
+
+		while (!l.spanStack.empty() && numSpanPxls < maxPixels) {
+			const int pxl = l.spanStack.back();
+			const int y   = pxl / sx;
+
+			l.spanStack.pop_back();
+
+			if (mskPxls[pxl] != -1) {
+				continue;
+			}
+
+			// grow the span to both sides within row <y>
+			int xmin = pxl % sx;
+			int xmax = xmin;
+
+			while (xmin > 0        && FILLABLE(y * sx + xmin - 1)) { xmin -= 1; }
+			while (xmax < (sx - 1) && FILLABLE(y * sx + xmax + 1)) { xmax += 1; }
+
+			for (int x = xmin; x <= xmax; x++) {
+				mskPxls[y * sx + x] = l.zoneMask;
+
+				#if (XAI_MASKMAP_DBG == 1)
+				l.zonePxls.push_back(y * sx + x);
+				#endif
+			}
+
+			numSpanPxls += ((xmax - xmin) + 1);
+
+			// diagonal neighbors make the rows above
+			// and below one pixel wider on each side
+			const int nxmin = std::max(xmin - 1, 0);
+			const int nxmax = std::min(xmax + 1, sx - 1);
+
+			for (int ny = y - 1; ny <= y + 1; ny += 2) {
+				if (ny < 0 || ny >= sy) {
+					continue;
+				}
+
+				for (int nx = nxmin; nx <= nxmax; nx++) {
+					if (!FILLABLE(ny * sx + nx)) {
+						continue;
+					}
+
+					l.spanStack.push_back(ny * sx + nx);
+
+					// skip the rest of this run, the
+					// seed's span will cover all of it
+					while (nx < nxmax && FILLABLE(ny * sx + nx + 1)) {
+						nx += 1;
+					}
+				}
+			}
+		}
+
+		#undef FILLABLE
+
+		l.pixelsMasked += numSpanPxls;
+		return numSpanPxls;
+	}
+
+	static unsigned int GetPassBit(const unsigned int* bits, int i) {
+		return ((bits[i >> 5] >> (i & 31)) & 1);
+	}
+
+	void FinishZone(const XAIMap<T>* pxlMap, LayerLabeller& l) {
+		#if (XAI_MASKMAP_DBG == 1)
+		const int sx = pxlMap->GetSizeX();
+		const XAIMaskMapZone<T> mapZone(l.zoneIdx % sx, l.zoneIdx / sx, GetPassBit(&l.passBits[0], l.zoneIdx) != 0, l.zonePxls);
+
+		zones[l.layer][l.zoneMask] = mapZone;
+		l.zonePxls.clear();
+		#endif
+
+		l.zoneIdx = -1;
+	}
+
+
+	void GetNonMaskedNeighbors(const XAIMap<T>* pm, const XAIMap<int>* mm, int p, MapPixelList& q) {
 		// if this pixel passes the filter, so
 		// must its neighbors (and vice versa)
 		// to count as part of the same region
 		const bool b = APPLY_FILTER(mpf, pm, p);
-		const int  x = p->GetX();
-		const int  y = p->GetY();
-
-		#define IDX(ngb) (ngb->GetY() * mm->GetSizeX() + ngb->GetX())
-		#define VAL(idx) ((mm->GetPixel(idx))->GetValue())
-		#define ADD(ngb) ((pm->InBounds(ngb)) && (VAL(IDX(ngb)) == -1) && (APPLY_FILTER(mpf, pm, ngb) == b))
-
-		const XAIMapPixel<T>* ngb = NULL;
-			// if coordinates are out of bounds, GetPixel() will
-			// return a default-value pixel with (x, y) = (-1, -1)
-			ngb = pm->GetConstPixel(x + 1, y + 1);  if (ADD(ngb)) { q.push_back(ngb); }
-			ngb = pm->GetConstPixel(x    , y + 1);  if (ADD(ngb)) { q.push_back(ngb); }
-			ngb = pm->GetConstPixel(x - 1, y + 1);  if (ADD(ngb)) { q.push_back(ngb); }
-			ngb = pm->GetConstPixel(x + 1, y    );  if (ADD(ngb)) { q.push_back(ngb); }
-			ngb = pm->GetConstPixel(x - 1, y    );  if (ADD(ngb)) { q.push_back(ngb); }
-			ngb = pm->GetConstPixel(x + 1, y - 1);  if (ADD(ngb)) { q.push_back(ngb); }
-			ngb = pm->GetConstPixel(x    , y - 1);  if (ADD(ngb)) { q.push_back(ngb); }
-			ngb = pm->GetConstPixel(x - 1, y - 1);  if (ADD(ngb)) { q.push_back(ngb); }
+		const int  x = p % pm->GetSizeX();
+		const int  y = p / pm->GetSizeX();
+
+		#define IDX(nx, ny) ((ny) * pm->GetSizeX() + (nx))
+		#define ADD(nx, ny) ((pm->InBounds(nx, ny)) && (mm->GetValue(IDX(nx, ny)) == -1) && (APPLY_FILTER(mpf, pm, IDX(nx, ny)) == b))
+
+			if (ADD(x + 1, y + 1)) { q.push_back(IDX(x + 1, y + 1)); }
+			if (ADD(x    , y + 1)) { q.push_back(IDX(x    , y + 1)); }
+			if (ADD(x - 1, y + 1)) { q.push_back(IDX(x - 1, y + 1)); }
+			if (ADD(x + 1, y    )) { q.push_back(IDX(x + 1, y    )); }
+			if (ADD(x - 1, y    )) { q.push_back(IDX(x - 1, y    )); }
+			if (ADD(x + 1, y - 1)) { q.push_back(IDX(x + 1, y - 1)); }
+			if (ADD(x    , y - 1)) { q.push_back(IDX(x    , y - 1)); }
+			if (ADD(x - 1, y - 1)) { q.push_back(IDX(x - 1, y - 1)); }
 
 		#undef ADD
-		#undef VAL
 		#undef IDX
 	}
 
-	int FloodFillPixel(const XAIMap<T>* pxlMap, XAIMap<int>* mskMap, int x, int y, ZoneMap& zoneMap, int zoneMask) {
+	int FloodFillPixel(const XAIMap<T>* pxlMap, XAIMap<int>* mskMap, int idx, ZoneMap& zoneMap, int zoneMask) {
 		MapPixelList zonePxls;
 		MapPixelList pxlQueue;
 
 		unsigned int numZonePxls = 0;
 
 		#if (XAI_MASKMAP_DBG == 1)
-		assert((pxlMap->GetConstPixel(x, y))->GetX() >= 0);
-		assert((pxlMap->GetConstPixel(x, y))->GetY() >= 0);
+		assert(pxlMap->InBounds(idx));
 		#endif
 
-		// initialize the queue with the pixel at <x, y>
-		pxlQueue.push_front(pxlMap->GetConstPixel(x, y));
+		// initialize the queue with the pixel at <idx>
+		pxlQueue.push_front(idx);
 
 		while (!pxlQueue.empty()) {
-			const XAIMapPixel<T>* pxl = pxlQueue.front();
+			const int pxl = pxlQueue.front();
 
-			const int pxlX = pxl->GetX();
-			const int pxlY = pxl->GetY();
-
-			if ((mskMap->GetPixel(pxlX, pxlY))->GetValue() == -1) {
-				(mskMap->GetPixel(pxlX, pxlY))->SetValue(zoneMask);
+			if (mskMap->GetValue(pxl) == -1) {
+				mskMap->SetValue(pxl, zoneMask);
 
 				#if (XAI_MASKMAP_DBG == 1)
 				zonePxls.push_back(pxl);
@@ -233,8 +635,8 @@ protected:
 		#if (XAI_MASKMAP_DBG == 1)
 		assert(numZonePxls == zonePxls.size());
 
-		const XAIMapPixel<T>* zonePxl = *(zonePxls.begin());
-		const XAIMaskMapZone<T> mapZone(x, y, APPLY_FILTER(mpf, pxlMap, zonePxl), zonePxls);
+		const int zonePxl = *(zonePxls.begin());
+		const XAIMaskMapZone<T> mapZone(zonePxl % pxlMap->GetSizeX(), zonePxl / pxlMap->GetSizeX(), APPLY_FILTER(mpf, pxlMap, zonePxl), zonePxls);
 
 		zoneMap[zoneMask] = mapZone;
 		#endif
@@ -252,6 +654,9 @@ protected:
 	ZoneMapVec zones;
 
 	XAIIMapPixelFilter<T>* mpf;
+
+	// progress of GenerateMasksStep
+	LayerLabeller stepLabeller;
 };
 
 #endif
@@ -1,9 +1,14 @@
 #include <sstream>
 #include <string>
 #include <cassert>
+#include <cmath>
 
-#include <list>
-#include <set>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
 
 #include "LegacyCpp/IAICallback.h"
 #include "LegacyCpp/IAICheats.h"
@@ -14,33 +19,150 @@
 #include "./XAIThreatMap.hpp"
 #include "../events/XAIIEvent.hpp"
 #include "../main/XAIHelper.hpp"
+#include "../trackers/XAIEnemySnapshot.hpp"
 #include "../units/XAIUnitDef.hpp"
 #include "../units/XAIUnitDefHandler.hpp"
+#include "../utils/XAILogger.hpp"
 #include "../utils/XAITimer.hpp"
 #include "../utils/XAIUtil.hpp"
 
 #define LUA_THREATMAP_DEBUG 1
+#define LUA_THREATMAP_DEBUG_INTERVAL 15
+#define XAI_THREATMAP_UPDATE_MODE XAI_THREATMAP_UPDATE_INCREMENTAL
+#define XAI_THREATMAP_INCREMENTAL_DEBUG 0
+// side (in threat-cells) of the tiles that carry their
+// own version, see GetVersion(const float3&)
+#define XAI_THREATMAP_VERSION_TILE 8
 
 XAIThreatMap::XAIThreatMap(XAIHelper* h):
-XAIMap<float>(HEIGHT2THREAT(h->rcb->GetMapWidth()), HEIGHT2THREAT(h->rcb->GetMapHeight()), 0.0f, XAI_THREAT_MAP) {
+XAIMap<float>(HEIGHT2THREAT(h->rcb->GetMapWidth()), HEIGHT2THREAT(h->rcb->GetMapHeight()), 0.0f, XAI_THREAT_MAP),
+ownInfluence(HEIGHT2THREAT(h->rcb->GetMapWidth()), HEIGHT2THREAT(h->rcb->GetMapHeight()), 0.0f, XAI_THREAT_MAP),
+netThreat(HEIGHT2THREAT(h->rcb->GetMapWidth()), HEIGHT2THREAT(h->rcb->GetMapHeight()), 0.0f, XAI_THREAT_MAP) {
 	xaih = h;
 
-	numUnitIDs    = 0;
 	numUnitDefIDs = 0;
 
 	avgThreat = 0.0f;
 	maxThreat = 0.0f;
 	sumThreat = 0.0f;
+
+	backMaxThreat = 0.0f;
+	backSumThreat = 0.0f;
+
+	updateMode   = XAI_THREATMAP_UPDATE_MODE;
+	updateWorker = NULL;
+	incResync    = true;
+
+	netThreatRect  = XAIMapRect(0, 0, mapx, mapy);
+	threatSATRow   = 0;
+	threatVersion  = 1;
+
+	overlayInterval = LUA_THREATMAP_DEBUG_INTERVAL;
+	overlayScaleExp = 0;
+}
+
+
+
+// persistent thread that rasterizes the back-buffer
+// from the snapshot of enemies gathered each frame
+struct XAIThreatMap::UpdateWorker {
+public:
+	UpdateWorker(XAIThreatMap* tm): threatMap(tm), jobPending(false), jobFinished(false), quit(false) {
+		thread = new boost::thread(boost::bind(&UpdateWorker::Run, this));
+	}
+	~UpdateWorker() {
+		{
+			boost::mutex::scoped_lock lock(mutex);
+			quit = true;
+		}
+
+		cond.notify_all();
+		thread->join();
+		delete thread;
+	}
+
+	void StartJob() {
+		boost::mutex::scoped_lock lock(mutex);
+		jobPending = true;
+		cond.notify_all();
+	}
+
+	// blocks until the pending job (if any) is done; returns
+	// true if the back-buffer holds a map not yet swapped in
+	bool WaitForJob() {
+		boost::mutex::scoped_lock lock(mutex);
+
+		while (jobPending) {
+			cond.wait(lock);
+		}
+
+		const bool ret = jobFinished;
+		jobFinished = false;
+		return ret;
+	}
+
+private:
+	void Run() {
+		while (true) {
+			{
+				boost::mutex::scoped_lock lock(mutex);
+
+				while (!jobPending && !quit) {
+					cond.wait(lock);
+				}
+
+				if (quit) {
+					return;
+				}
+			}
+
+			threatMap->RasterizeBackBuffer();
+
+			{
+				boost::mutex::scoped_lock lock(mutex);
+				jobPending  = false;
+				jobFinished = true;
+			}
+
+			cond.notify_all();
+		}
+	}
+
+	XAIThreatMap* threatMap;
+
+	boost::thread* thread;
+	boost::mutex mutex;
+	boost::condition_variable cond;
+
+	bool jobPending;
+	bool jobFinished;
+	bool quit;
+};
+
+
+
+XAIThreatMap::~XAIThreatMap() {
+	// normally already stopped by XAI_EVENT_RELEASE
+	delete updateWorker; updateWorker = NULL;
 }
 
 void XAIThreatMap::OnEvent(const XAIIEvent* e) {
 	switch (e->type) {
 		case XAI_EVENT_UNIT_CREATED: {} break;
 		case XAI_EVENT_UNIT_FINISHED: {} break;
-		case XAI_EVENT_UNIT_DESTROYED: {} break;
+		case XAI_EVENT_UNIT_DESTROYED: {
+			const XAIUnitDestroyedEvent* ee = dynamic_cast<const XAIUnitDestroyedEvent*>(e);
+			DelInfluence(ee->unitID);
+		} break;
 		case XAI_EVENT_UNIT_DAMAGED: {} break;
 		case XAI_EVENT_UNIT_GIVEN: {} break;
-		case XAI_EVENT_UNIT_CAPTURED: {} break;
+		case XAI_EVENT_UNIT_CAPTURED: {
+			const XAIUnitCapturedEvent* ee = dynamic_cast<const XAIUnitCapturedEvent*>(e);
+
+			if (ee->oldUnitTeam == xaih->rcb->GetMyTeam()) {
+				DelInfluence(ee->unitID);
+			}
+		} break;
 
 		case XAI_EVENT_INIT: {
 			Init();
@@ -49,8 +171,11 @@ void XAIThreatMap::OnEvent(const XAIIEvent* e) {
 			Update();
 		} break;
 		case XAI_EVENT_RELEASE: {
-			unitIDs.clear();
+			delete updateWorker; updateWorker = NULL;
+
 			unitDefIDs.clear();
+			enemyUnits.clear();
+			ownStamps.clear();
 		} break;
 
 		default: {
@@ -59,9 +184,25 @@ void XAIThreatMap::OnEvent(const XAIIEvent* e) {
 }
 
 void XAIThreatMap::Init() {
-	unitIDs.resize(MAX_UNITS);
 	unitDefIDs.resize(xaih->rcb->GetNumUnitDefs() + 1, 0);
-	threatCells.resize(mapx * mapy, ThreatCell());
+	threatCells.Init(mapx * mapy);
+	threatPyramid.Init(&netThreat);
+	ownStamps.resize(MAX_UNITS);
+	backValues.resize(mapx * mapy, 0.0f);
+	backThreatCells.Init(mapx * mapy);
+
+	tilesx = (mapx + XAI_THREATMAP_VERSION_TILE - 1) / XAI_THREATMAP_VERSION_TILE;
+	tilesz = (mapy + XAI_THREATMAP_VERSION_TILE - 1) / XAI_THREATMAP_VERSION_TILE;
+	tileVersions.resize(tilesx * tilesz, threatVersion);
+
+	// build the span-tables for all radii up-front
+	for (int defID = 1; defID <= xaih->rcb->GetNumUnitDefs(); defID++) {
+		const XAIUnitDef* def = xaih->unitDefHandler->GetUnitDefByID(defID);
+
+		if (def->maxWeaponRange > 0.0f) {
+			GetDiscSpans(HEIGHT2THREAT(WORLD2HEIGHT(int(def->maxWeaponRange * 1.25f))));
+		}
+	}
 
 	#if (LUA_THREATMAP_DEBUG == 1)
 	std::stringstream luaDataStream;
@@ -69,6 +210,7 @@ void XAIThreatMap::Init() {
 		luaDataStream << "GG.AIThreatMap[\"threatMapSizeZ\"] = " << mapy << ";\n";
 		luaDataStream << "GG.AIThreatMap[\"threatMapResX\"]  = " << (1 << THREATMAP_RESOLUTION) << ";\n";
 		luaDataStream << "GG.AIThreatMap[\"threatMapResZ\"]  = " << (1 << THREATMAP_RESOLUTION) << ";\n";
+		luaDataStream << "GG.AIThreatMap[\"threatMapScale\"] = 1.0;\n";
 		luaDataStream << "\n";
 		luaDataStream << "local threatMapSizeX = GG.AIThreatMap[\"threatMapSizeX\"];\n";
 		luaDataStream << "local threatMapSizeZ = GG.AIThreatMap[\"threatMapSizeZ\"];\n";
@@ -83,6 +225,10 @@ void XAIThreatMap::Init() {
 
 	xaih->rcb->CallLuaRules("[AI::XAI::ThreatMap::Init]", -1, NULL);
 	xaih->rcb->CallLuaRules(luaDataStr.c_str(), -1, NULL);
+
+	// matches the zeroes the Lua side starts out with
+	overlayCells.resize(mapx * mapy, 0);
+	overlayDelta.resize(mapx * mapy, 0);
 	#endif
 }
 
@@ -91,198 +237,706 @@ void XAIThreatMap::Init() {
 
 
 
-/*
+// stamped values are rounded to a multiple of this
+// (power-of-two) quantum, so that adding and removing
+// them again in incremental mode is exact and no drift
+// can accumulate in the threat-map
+#define THREATMAP_QUANTUM 16.0f
+// number of discrete health levels an enemy unit's
+// threat-value is scaled by (a unit only needs to be
+// re-stamped when it crosses into a different level)
+#define THREATMAP_HEALTH_BUCKETS 16
+
+static inline float QuantizeThreat(float v) {
+	return (floorf(v * THREATMAP_QUANTUM + 0.5f) / THREATMAP_QUANTUM);
+}
+
+static inline int GetHealthBucket(float healthRatio) {
+	return (std::max(0, std::min(THREATMAP_HEALTH_BUCKETS - 1, int(healthRatio * THREATMAP_HEALTH_BUCKETS))));
+}
+
+static inline float GetHealthScale(int healthBucket) {
+	return ((healthBucket + 1) / float(THREATMAP_HEALTH_BUCKETS));
+}
+
+// adds <v> to <len> consecutive values of a map row
+static inline void AddThreatSpan(float* row, int len, float v) {
+	int i = 0;
+
+	#ifdef __SSE__
+	const __m128 vv = _mm_set1_ps(v);
+
+	for (; (i + 4) <= len; i += 4) {
+		_mm_storeu_ps(row + i, _mm_add_ps(_mm_loadu_ps(row + i), vv));
+	}
+	#endif
+
+	for (; i < len; i++) {
+		row[i] += v;
+	}
+}
+
+// adds <v> to all cells of <values> (a <mapx> by <mapy>
+// map) inside the disc of radius <tr> around <tx, tz>
+static void StampDisc(float* values, int mapx, int mapy, const std::vector<int>& spans, int tx, int tz, int tr, float v) {
+	// clip the disc's rows against the map once
+	const int zmin = std::max(tz - tr,        0);
+	const int zmax = std::min(tz + tr, mapy - 1);
+
+	for (int z = zmin; z <= zmax; z++) {
+		const int w = spans[z - tz + tr];
+		const int xmin = std::max(tx - w,        0);
+		const int xmax = std::min(tx + w, mapx - 1);
+
+		if (xmin > xmax) {
+			continue;
+		}
+
+		// note: values are not clamped here (this would
+		// make stamps irreversible) but when read instead
+		AddThreatSpan(&values[z * mapx + xmin], (xmax - xmin) + 1, v);
+	}
+}
+
+
+
+void XAIThreatMap::Update() {
+	if (updateMode != XAI_THREATMAP_UPDATE_THREADED && updateWorker != NULL) {
+		// switched away from threaded mode, drop the
+		// result of the job started last frame if any
+		updateWorker->WaitForJob();
+	}
+
+	switch (updateMode) {
+		case XAI_THREATMAP_UPDATE_FULL: {
+			FullUpdate();
+		} break;
+		case XAI_THREATMAP_UPDATE_INCREMENTAL: {
+			#if (XAI_THREATMAP_INCREMENTAL_DEBUG == 1)
+			DebugCompareUpdate();
+			#else
+			FastUpdate();
+			#endif
+		} break;
+		case XAI_THREATMAP_UPDATE_THREADED: {
+			ThreadedUpdate();
+		} break;
+	}
+
+
+	#if (LUA_THREATMAP_DEBUG == 1)
+	if (overlayInterval > 0 && (xaih->GetCurrFrame() % overlayInterval) == 0) {
+		UpdateDebugOverlay();
+	}
+	#endif
+}
+
+// the overlay stores every cell as one byte (the threat
+// relative to a power-of-two scale that only ever grows)
+// and the Lua side is sent the runs of cells whose byte
+// changed since the last update, see data/XAIThreatMap.lua
+#define OVERLAY_PROTOCOL_VERSION 1
+// unchanged cells between two changed ones are sent as
+// part of the same run if that is no more expensive than
+// starting a new run (which costs at least two bytes)
+#define OVERLAY_MAX_RUN_GAP 2
+
+static void PutVarInt(std::string& s, unsigned int v) {
+	while (v >= 0x80) {
+		s.push_back(char((v & 0x7F) | 0x80)); v >>= 7;
+	}
+
+	s.push_back(char(v));
+}
+
+void XAIThreatMap::UpdateDebugOverlay() {
+	XAICScopedTimer t("[XAIThreatMap::UpdateDebugOverlay]", xaih->timer);
+
+	const int area = mapx * mapy;
+	const float* net = netThreat.GetData();
+
+	UpdateNetThreat();
+
+	float maxValue = 0.0f;
+
+	for (int tIdx = 0; tIdx < area; tIdx++) {
+		maxValue = std::max(maxValue, net[tIdx]);
+	}
+
+	// if the scale has to grow, every cell is re-sent
+	bool rescaled = false;
+
+	while (maxValue > float(1 << overlayScaleExp) && overlayScaleExp < 30) {
+		overlayScaleExp += 1; rescaled = true;
+	}
+
+	const float scale = 255.0f / float(1 << overlayScaleExp);
+
+	for (int tIdx = 0; tIdx < area; tIdx++) {
+		overlayDelta[tIdx] = (unsigned char) std::min(255.0f, net[tIdx] * scale + 0.5f);
+
+		if (rescaled) {
+			overlayCells[tIdx] = ~overlayDelta[tIdx];
+		}
+	}
+
+	overlayMsg.clear();
+	overlayMsg.push_back(char(OVERLAY_PROTOCOL_VERSION));
+	overlayMsg.push_back(char(overlayScaleExp));
+
+	// each run is encoded as <skip, count, count bytes>
+	// with skip relative to the end of the previous run
+	for (int i = 0, last = 0; i < area; ) {
+		if (overlayDelta[i] == overlayCells[i]) {
+			i++; continue;
+		}
+
+		int j = i + 1;
+		int k = i + 1;
+
+		for (; j < area && (j - k) <= OVERLAY_MAX_RUN_GAP; j++) {
+			if (overlayDelta[j] != overlayCells[j]) {
+				k = j + 1;
+			}
+		}
+
+		PutVarInt(overlayMsg, i - last);
+		PutVarInt(overlayMsg, k - i);
+		overlayMsg.append((const char*) &overlayDelta[i], k - i);
+
+		last = k;
+		i    = k;
+	}
+
+	overlayCells.swap(overlayDelta);
+
+	if (overlayMsg.size() <= 2) {
+		return;
+	}
+
+	// the message is binary, so its size has to be explicit
+	xaih->rcb->CallLuaRules("[AI::XAI::ThreatMap::Delta]", -1, NULL);
+	xaih->rcb->CallLuaRules(overlayMsg.data(), overlayMsg.size(), NULL);
+}
+
+void XAIThreatMap::ResetUnitDefCounts() {
+	numUnitDefIDs = 0;
+
+	for (int defID = 1; defID <= xaih->rcb->GetNumUnitDefs(); defID++) {
+		unitDefIDs[defID] = 0;
+	}
+}
+
+// counts the UnitDef of snapshot row <row> and adds the
+// threat-value of armed enemies to <pwrSum> and <pwrMax>; only
+// returns true (with <s> filled in) for enemies that have
+// a weapon range and so should be stamped onto the map
+bool XAIThreatMap::GetRowStamp(int row, RowStamp* s, float* pwrSum, float* pwrMax) {
+	const XAICEnemySnapshot* enemies = xaih->enemySnapshot;
+	const int unitDefID = enemies->GetUnitDefID(row);
+
+	if (unitDefIDs[unitDefID] == 0) {
+		numUnitDefIDs += 1;
+	}
+
+	unitDefIDs[unitDefID] += 1;
+
+	const XAIUnitDef* xaiUnitDef = xaih->unitDefHandler->GetUnitDefByID(unitDefID);
+
+	if (xaiUnitDef->GetDef()->weapons.empty()) {
+		return false;
+	}
+
+	s->unitDefID = unitDefID;
+	s->pos       = enemies->GetUnitPos(row);
+	s->hb        = GetHealthBucket(enemies->GetHealthRatio(row));
+	s->pwr       = QuantizeThreat(xaiUnitDef->GetPower() * GetHealthScale(s->hb));
+
+	*pwrSum += s->pwr;
+	*pwrMax  = std::max(*pwrMax, s->pwr);
+
+	if (xaiUnitDef->maxWeaponRange <= 0.0f) {
+		return false;
+	}
+
+	s->tx = std::max(0, std::min(mapx - 1, HEIGHT2THREAT(WORLD2HEIGHT(int(s->pos.x)))));
+	s->tz = std::max(0, std::min(mapy - 1, HEIGHT2THREAT(WORLD2HEIGHT(int(s->pos.z)))));
+	s->tr = HEIGHT2THREAT(WORLD2HEIGHT(int(xaiUnitDef->maxWeaponRange * 1.25f)));
+	return true;
+}
+
 void XAIThreatMap::FastUpdate() {
 	XAICScopedTimer t("[XAIThreatMap::FastUpdate]", xaih->timer);
 
+	const unsigned int frame = xaih->GetCurrFrame();
+
 	avgThreat = 0.0f;
 	maxThreat = 0.0f;
 	sumThreat = 0.0f;
 
-	numUnitIDs = xaih->ccb->GetEnemyUnits(&unitIDs[0], MAX_UNITS);
+	const XAICEnemySnapshot* enemies = xaih->enemySnapshot;
 
-	std::list<int> unitsCreated;
-	std::list<int> unitsDestroyed;
-	std::set<int> units;
+	ResetUnitDefCounts();
 
-	for (int i = 0; i < numUnitIDs; i++) {
-		const int      unitID  = unitIDs[i];
-		const UnitDef* unitDef = xaih->ccb->GetUnitDef(unitID);
+	if (incResync) {
+		// first incremental update (or mode switch),
+		// start over from an empty map and treat all
+		// enemies as having just appeared
+		for (int tIdx = (mapx * mapy) - 1; tIdx >= 0; tIdx--) {
+			values[tIdx] = 0.0f;
+		}
 
-		assert(unitDef != NULL);
-		// copy each unitID
-		units.insert(unitID);
+		MarkAllChanged();
 
-		if (enemyUnits.find(unitID) == enemyUnits.end()) {
-			unitsCreated.push_back(unitID);
+		enemyUnits.clear();
 
-			if (unitDefIDs[unitDef->id] == 0) {
-				numUnitDefIDs += 1;
-			}
+		incResync = false;
+	}
+
+	RowStamp rs;
 
-			unitDefIDs[unitDef->id] += 1;
+	for (int row = 0; row < enemies->GetNumRows(); row++) {
+		if (!GetRowStamp(row, &rs, &sumThreat, &maxThreat)) {
+			continue;
 		}
-	}
 
-	for (std::map<int, EnemyUnit>::const_iterator it = enemyUnits.begin(); it != enemyUnits.end(); it++) {
-		if (units.find(it->first) == units.end()) {
-			unitsDestroyed.push_back(it->first);
+		const int unitID = enemies->GetUnitID(row);
+
+		std::map<int, EnemyUnit>::iterator it = enemyUnits.find(unitID);
 
-			const EnemyUnit& u = it->second;
+		if (it == enemyUnits.end()) {
+			it = enemyUnits.insert(std::pair<int, EnemyUnit>(unitID, EnemyUnit(unitID, -1, rs.pos))).first;
+		}
+
+		EnemyUnit& u = it->second;
 
-			assert(unitDefIDs[u.unitDefID] > 0);
-			unitDefIDs[u.unitDefID] -= 1;
+		// note: unitDefID also changes if an ID is re-used
+		// by a new unit in the same frame the old one died
+		const bool restamp =
+			(u.unitDefID != rs.unitDefID) ||
+			(u.tx != rs.tx) || (u.tz != rs.tz) ||
+			(u.tr != rs.tr) || (u.hb != rs.hb);
 
-			if (unitDefIDs[u.unitDefID] == 0) {
-				numUnitDefIDs -= 1;
+		if (restamp) {
+			if (u.unitDefID != -1) {
+				StampEnemyUnit(u, -1.0f);
 			}
+
+			u.unitDefID = rs.unitDefID;
+			u.tx        = rs.tx;
+			u.tz        = rs.tz;
+			u.tr        = rs.tr;
+			u.hb        = rs.hb;
+			u.pwr       = rs.pwr;
+
+			StampEnemyUnit(u, 1.0f);
 		}
+
+		u.pos   = rs.pos;
+		u.frame = frame;
 	}
 
+	// remove the stamps of enemies that were not seen this frame
+	for (std::map<int, EnemyUnit>::iterator it = enemyUnits.begin(); it != enemyUnits.end(); ) {
+		if ((it->second).frame != frame) {
+			StampEnemyUnit(it->second, -1.0f);
+			enemyUnits.erase(it++);
+		} else {
+			++it;
+		}
+	}
 
+	// the cell-counts are cheap enough to simply be
+	// rebuilt from all tracked enemies every update
+	threatCells.Clear();
 
-	for (std::list<int>::const_iterator it = unitsCreated.begin(); it != unitsCreated.end(); it++) {
-		enemyUnits[*it] = EnemyUnit(*it, (xaih->ccb->GetUnitDef(*it))->id, xaih->ccb->GetUnitPos(*it));
+	for (std::map<int, EnemyUnit>::const_iterator it = enemyUnits.begin(); it != enemyUnits.end(); ++it) {
+		threatCells.AddUnit((it->second).tz * mapx + (it->second).tx, (it->second).unitDefID);
 	}
 
-	for (std::list<int>::const_iterator it = unitsDestroyed.begin(); it != unitsDestroyed.end(); it++) {
-		const EnemyUnit& u = enemyUnits[*it];
-		const XAIUnitDef* uDef = xaih->unitDefHandler->GetUnitDefByID(u.unitDefID);
+	threatCells.Build();
 
-		AddThreatX(u.pos, uDef->maxWeaponRange, -(uDef->GetPower() * u.pwr));
-		enemyUnits.erase(*it);
+	avgThreat = sumThreat / (mapx * mapy);
+}
+
+void XAIThreatMap::FullUpdate() {
+	XAICScopedTimer t("[XAIThreatMap::FullUpdate]", xaih->timer);
+
+	avgThreat = 0.0f;
+	maxThreat = 0.0f;
+	sumThreat = 0.0f;
+
+	const XAICEnemySnapshot* enemies = xaih->enemySnapshot;
+
+	ResetUnitDefCounts();
+
+	// reset all values (expensive)
+	for (int tIdx = (mapx * mapy) - 1; tIdx >= 0; tIdx--) {
+		values[tIdx] = 0.0f;
 	}
 
+	threatCells.Clear();
+	MarkAllChanged();
 
-	for (std::map<int, EnemyUnit>::iterator it = enemyUnits.begin(); it != enemyUnits.end(); it++) {
-		EnemyUnit& u = it->second;
+	// the incremental state is invalidated by a full rebuild
+	enemyUnits.clear();
+	incResync = true;
 
-		const XAIUnitDef* uDef = xaih->unitDefHandler->GetUnitDefByID(u.unitDefID);
+	RowStamp rs;
 
-		if (uDef->GetDef()->weapons.empty())
-			continue;
-		if (uDef->maxWeaponRange <= 0.0f)
+	for (int row = 0; row < enemies->GetNumRows(); row++) {
+		if (!GetRowStamp(row, &rs, &sumThreat, &maxThreat)) {
 			continue;
+		}
 
-		// remove the unit's old threat-value
-		AddThreatX(u.pos, uDef->maxWeaponRange, -(uDef->GetPower() * u.pwr));
-
-		u.pwr = xaih->ccb->GetUnitHealth(u.unitID) / xaih->ccb->GetUnitMaxHealth(u.unitID);
-		u.pos = xaih->ccb->GetUnitPos(u.unitID);
+		// track per-cell statistics for enemies
+		threatCells.AddUnit(rs.tz * mapx + rs.tx, rs.unitDefID);
 
-		// add the unit's new threat-value
-		AddThreatX(u.pos, uDef->maxWeaponRange, +(uDef->GetPower() * u.pwr));
+		AddThreat(rs.tx, rs.tz, rs.tr, rs.pwr);
 	}
+
+	threatCells.Build();
+
+	avgThreat = sumThreat / (mapx * mapy);
 }
-*/
 
+// publishes the map rasterized by the worker during the
+// previous frame and hands it a snapshot of the current
+// enemies, so that only the snapshot is built on the AI
+// thread and consumers see a consistent one-frame-old map
+void XAIThreatMap::ThreadedUpdate() {
+	XAICScopedTimer t("[XAIThreatMap::ThreadedUpdate]", xaih->timer);
 
+	if (updateWorker == NULL) {
+		updateWorker = new UpdateWorker(this);
+	}
 
+	// normally finished long before the next frame
+	if (updateWorker->WaitForJob()) {
+		SwapBuffers();
+	}
 
+	// the incremental state is invalidated by a swap
+	enemyUnits.clear();
+	incResync = true;
 
+	const XAICEnemySnapshot* enemies = xaih->enemySnapshot;
 
-void XAIThreatMap::Update() {
-	XAICScopedTimer t("[XAIThreatMap::Update]", xaih->timer);
+	ResetUnitDefCounts();
 
-	avgThreat = 0.0f;
-	maxThreat = 0.0f;
-	sumThreat = 0.0f;
+	backStamps.clear();
+	backMaxThreat = 0.0f;
+	backSumThreat = 0.0f;
 
-	numUnitIDs    = xaih->ccb->GetEnemyUnits(&unitIDs[0], MAX_UNITS);
-	numUnitDefIDs = 0;
+	RowStamp rs;
+
+	for (int row = 0; row < enemies->GetNumRows(); row++) {
+		if (!GetRowStamp(row, &rs, &backSumThreat, &backMaxThreat)) {
+			continue;
+		}
 
+		// span-tables are only ever built on this thread
+		backStamps.push_back(EnemyStamp(rs.unitDefID, rs.tx, rs.tz, rs.tr, rs.pwr, &GetDiscSpans(rs.tr)));
+	}
 
-	for (int defID = 1; defID <= xaih->rcb->GetNumUnitDefs(); defID++) {
-		unitDefIDs[defID] = 0;
+	updateWorker->StartJob();
+}
+
+// runs on the worker thread, touches only the back-buffers
+void XAIThreatMap::RasterizeBackBuffer() {
+	std::fill(backValues.begin(), backValues.end(), 0.0f);
+
+	backThreatCells.Clear();
+
+	for (std::vector<EnemyStamp>::const_iterator it = backStamps.begin(); it != backStamps.end(); ++it) {
+		backThreatCells.AddUnit(it->tz * mapx + it->tx, it->unitDefID);
+
+		StampDisc(&backValues[0], mapx, mapy, *(it->spans), it->tx, it->tz, it->tr, it->tv);
 	}
 
-	// reset all values (expensive)
+	backThreatCells.Build();
+}
+
+void XAIThreatMap::SwapBuffers() {
+	values.swap(backValues);
+	threatCells.Swap(backThreatCells);
+
+	maxThreat = backMaxThreat;
+	sumThreat = backSumThreat;
+	avgThreat = sumThreat / (mapx * mapy);
+
+	MarkAllChanged();
+}
+
+// runs an incremental update followed by a full
+// rebuild and logs any cells on which they differ
+void XAIThreatMap::DebugCompareUpdate() {
+	FastUpdate();
+
+	std::vector<float> incValues(values);
+	std::vector<int> incCounts(mapx * mapy, 0);
+	std::map<int, EnemyUnit> incEnemyUnits(enemyUnits);
+
 	for (int tIdx = (mapx * mapy) - 1; tIdx >= 0; tIdx--) {
-		pixels[tIdx].SetValue(0.0f);
+		incCounts[tIdx] = threatCells.GetUnitCount(tIdx);
+	}
+
+	FullUpdate();
 
-		threatCells[tIdx].N = 0;
-		threatCells[tIdx].M.clear();
+	int numValueDiffs = 0;
+	int numCountDiffs = 0;
+
+	for (int tIdx = (mapx * mapy) - 1; tIdx >= 0; tIdx--) {
+		numValueDiffs += int(incValues[tIdx] != values[tIdx]);
+		numCountDiffs += int(incCounts[tIdx] != threatCells.GetUnitCount(tIdx));
 	}
 
-	for (int i = 0; i < numUnitIDs; i++) {
-		const int      unitID  = unitIDs[i];
-		const UnitDef* unitDef = xaih->ccb->GetUnitDef(unitID);
+	if (numValueDiffs > 0 || numCountDiffs > 0) {
+		LOG_BASIC(
+			xaih->logger,
+			"[XAIThreatMap::DebugCompareUpdate][frame=" << xaih->GetCurrFrame() << "]" <<
+			" incremental update differs from full rebuild in " <<
+			numValueDiffs << " threat-values and " <<
+			numCountDiffs << " cell-counts"
+		);
+	}
 
-		if (unitDef == NULL)
-			continue;
+	// FullUpdate() invalidated the incremental state; it
+	// is only still usable if both results were identical
+	enemyUnits = incEnemyUnits;
+	incResync  = (numValueDiffs > 0 || numCountDiffs > 0);
+}
 
-		if (unitDefIDs[unitDef->id] == 0) {
-			numUnitDefIDs += 1;
+// bumps the version of every tile whose cells, or the
+// box-filter of GetThreat around them, overlap <r>, and
+// adds <r> to the region the net-values, their SAT and
+// pyramid are rebuilt over by the next query
+void XAIThreatMap::MarkChanged(const XAIMapRect& r) {
+	threatPyramid.MarkDirty(r);
+	threatVersion += 1;
+
+	XAIMapRect cr = r;
+	cr.ClipTo(mapx, mapy);
+
+	if (!cr.IsEmpty()) {
+		if (netThreatRect.IsEmpty()) {
+			netThreatRect = cr;
+		} else {
+			netThreatRect.xmin = std::min(netThreatRect.xmin, cr.xmin);
+			netThreatRect.zmin = std::min(netThreatRect.zmin, cr.zmin);
+			netThreatRect.xmax = std::max(netThreatRect.xmax, cr.xmax);
+			netThreatRect.zmax = std::max(netThreatRect.zmax, cr.zmax);
 		}
 
-		unitDefIDs[unitDef->id] += 1;
+		threatSATRow = std::min(threatSATRow, cr.zmin);
+	}
 
-		if (unitDef->weapons.empty()) {
-			continue;
+	const int txmin = std::max(r.xmin - 1,    0) / XAI_THREATMAP_VERSION_TILE;
+	const int tzmin = std::max(r.zmin - 1,    0) / XAI_THREATMAP_VERSION_TILE;
+	const int txmax = std::min(r.xmax + 1, mapx) / XAI_THREATMAP_VERSION_TILE;
+	const int tzmax = std::min(r.zmax + 1, mapy) / XAI_THREATMAP_VERSION_TILE;
+
+	for (int tz = tzmin; tz <= std::min(tzmax, tilesz - 1); tz++) {
+		for (int tx = txmin; tx <= std::min(txmax, tilesx - 1); tx++) {
+			tileVersions[tz * tilesx + tx] = threatVersion;
 		}
+	}
+}
 
-		const XAIUnitDef* xaiUnitDef = xaih->unitDefHandler->GetUnitDefByID(unitDef->id);
+void XAIThreatMap::MarkAllChanged() {
+	threatPyramid.MarkAllDirty();
+	threatVersion += 1;
 
-		const float3& unitPos    = xaih->ccb->GetUnitPos(unitID);
-		const float   unitHealth = xaih->ccb->GetUnitHealth(unitID) / xaih->ccb->GetUnitMaxHealth(unitID);
-		const float   unitPower  = xaiUnitDef->GetPower() * unitHealth;
-		const float   unitRange  = xaiUnitDef->maxWeaponRange * 1.25f;
+	netThreatRect = XAIMapRect(0, 0, mapx, mapy);
+	threatSATRow  = 0;
 
-		if (xaiUnitDef->maxWeaponRange > 0.0f) {
-			const int tx = HEIGHT2THREAT(WORLD2HEIGHT(int(unitPos.x)));
-			const int tz = HEIGHT2THREAT(WORLD2HEIGHT(int(unitPos.z)));
-			const int tr = HEIGHT2THREAT(WORLD2HEIGHT(int(unitRange)));
+	std::fill(tileVersions.begin(), tileVersions.end(), threatVersion);
+}
 
-			// track per-cell statistics for enemies
-			threatCells[tz * mapx + tx].N              += 1;
-			threatCells[tz * mapx + tx].M[unitDef->id] += 1;
+unsigned int XAIThreatMap::GetVersion(const float3& p) const {
+	const int tx = std::max(0, std::min(mapx - 1, HEIGHT2THREAT(WORLD2HEIGHT(int(p.x)))));
+	const int tz = std::max(0, std::min(mapy - 1, HEIGHT2THREAT(WORLD2HEIGHT(int(p.z)))));
 
-			AddThreat(tx, tz, tr, unitPower);
+	return tileVersions[(tz / XAI_THREATMAP_VERSION_TILE) * tilesx + (tx / XAI_THREATMAP_VERSION_TILE)];
+}
+
+void XAIThreatMap::StampEnemyUnit(const EnemyUnit& u, float sign) {
+	AddThreat(u.tx, u.tz, u.tr, u.pwr * sign);
+}
+
+void XAIThreatMap::StampInfluence(const ThreatStamp& s, float sign) {
+	MarkChanged(XAIMapRect(s.tx - s.tr, s.tz - s.tr, s.tx + s.tr + 1, s.tz + s.tr + 1));
+
+	StampDisc(ownInfluence.GetData(), mapx, mapy, GetDiscSpans(s.tr), s.tx, s.tz, s.tr, s.tv * sign);
+}
+
+
+
+void XAIThreatMap::ThreatCellTable::Init(int numCells) {
+	cellGens.resize(numCells, 0);
+	cellUnits.resize(numCells, 0);
+	cellFirst.resize(numCells, 0);
+	cellLast.resize(numCells, 0);
+
+	gen = 1;
+}
+
+unsigned int XAIThreatMap::ThreatCellTable::ResetGens() {
+	std::fill(cellGens.begin(), cellGens.end(), 0);
+	return 1;
+}
+
+void XAIThreatMap::ThreatCellTable::Build() {
+	cells.clear();
+	entries.clear();
+	sorted.resize(records.size());
+
+	// count the units per cell, touching only occupied cells
+	for (std::vector<Record>::const_iterator it = records.begin(); it != records.end(); ++it) {
+		const int c = it->cell;
+
+		if (cellGens[c] != gen) {
+			cellGens[c]  = gen;
+			cellUnits[c] = 0;
+			cells.push_back(c);
 		}
 
-		sumThreat += unitPower;
-		maxThreat  = std::max(maxThreat, unitPower);
+		cellUnits[c] += 1;
 	}
 
-	avgThreat = sumThreat / (mapx * mapy);
+	// exclusive prefix-sum over the occupied cells gives
+	// each cell's offset into the sorted records, which
+	// is then used as the cell's scatter cursor
+	for (int i = 0, n = 0; i < int(cells.size()); i++) {
+		cellFirst[cells[i]] = n; n += cellUnits[cells[i]];
+	}
 
+	for (std::vector<Record>::const_iterator it = records.begin(); it != records.end(); ++it) {
+		sorted[cellFirst[it->cell]++] = *it;
+	}
 
-	#if (LUA_THREATMAP_DEBUG == 1)
-	if ((xaih->GetCurrFrame() % 15) == 0) {
-		std::string luaDataStr;
-		std::stringstream luaDataStream;
-			luaDataStream << "local threatMapArray = GG.AIThreatMap;\n";
+	// collapse each cell's run of records into (defID, count)
+	// entries; runs are tiny so an insertion-sort suffices
+	for (int i = 0; i < int(cells.size()); i++) {
+		const int c = cells[i];
+		const int j = cellFirst[c] - cellUnits[c];
+		const int k = cellFirst[c];
 
-		// normalize the values for visualization
-		for (int tIdx = (mapx * mapy) - 1; tIdx >= 0; tIdx--) {
-			luaDataStream << "threatMapArray[" << tIdx << "]";
-			luaDataStream << " = ";
-			luaDataStream << (pixels[tIdx].GetValue() / maxThreat);
-			luaDataStream << ";\n";
+		for (int a = j + 1; a < k; a++) {
+			const Record r = sorted[a];
+			int b = a - 1;
+
+			for (; b >= j && sorted[b].unitDefID > r.unitDefID; b--) {
+				sorted[b + 1] = sorted[b];
+			}
+
+			sorted[b + 1] = r;
 		}
 
-		luaDataStr = luaDataStream.str();
+		cellFirst[c] = entries.size();
+
+		for (int a = j; a < k; a++) {
+			if (int(entries.size()) > cellFirst[c] && entries.back().unitDefID == sorted[a].unitDefID) {
+				entries.back().count += 1;
+			} else {
+				entries.push_back(Entry(sorted[a].unitDefID, 1));
+			}
+		}
 
-		xaih->rcb->CallLuaRules("[AI::XAI::ThreatMap::Update]", -1, NULL);
-		xaih->rcb->CallLuaRules(luaDataStr.c_str(), -1, NULL);
+		cellLast[c] = entries.size();
 	}
-	#endif
 }
 
+void XAIThreatMap::ThreatCellTable::Swap(ThreatCellTable& t) {
+	records.swap(t.records);
+	sorted.swap(t.sorted);
+	entries.swap(t.entries);
+	cells.swap(t.cells);
 
+	cellGens.swap(t.cellGens);
+	cellUnits.swap(t.cellUnits);
+	cellFirst.swap(t.cellFirst);
+	cellLast.swap(t.cellLast);
 
-void XAIThreatMap::AddThreatExt(const float3& p, float r, float v) {
-	// position is in world-coordinates; first
-	// convert it to heightmap-space and then
-	// to threatmap-space
-	const int tx = HEIGHT2THREAT(WORLD2HEIGHT(int(p.x)));
-	const int tz = HEIGHT2THREAT(WORLD2HEIGHT(int(p.z)));
+	std::swap(gen, t.gen);
+}
+
+
+
+void XAIThreatMap::SetInfluence(int unitID, const float3& p, float r, float v) {
+	const int tx = std::max(0, std::min(mapx - 1, HEIGHT2THREAT(WORLD2HEIGHT(int(p.x)))));
+	const int tz = std::max(0, std::min(mapy - 1, HEIGHT2THREAT(WORLD2HEIGHT(int(p.z)))));
 	const int tr = HEIGHT2THREAT(WORLD2HEIGHT(int(r)));
+	const float tv = QuantizeThreat(v);
+
+	ThreatStamp& s = ownStamps[unitID];
+
+	// most units stay inside the same cell for many frames
+	if (s.tx == tx && s.tz == tz && s.tr == tr && s.tv == tv) {
+		return;
+	}
+
+	// both stamps are multiples of the threat quantum,
+	// so moving one leaves no residue behind in the map
+	if (s.tr >= 0) {
+		StampInfluence(s, -1.0f);
+	}
+
+	s = ThreatStamp(tx, tz, tr, tv);
 
-	AddThreat(tx, tz, tr, v);
+	if (s.tr >= 0) {
+		StampInfluence(s, 1.0f);
+	}
+}
+
+void XAIThreatMap::DelInfluence(int unitID) {
+	if (unitID < 0 || unitID >= int(ownStamps.size())) {
+		return;
+	}
+
+	ThreatStamp& s = ownStamps[unitID];
+
+	if (s.tr >= 0) {
+		StampInfluence(s, -1.0f);
+	}
+
+	s = ThreatStamp();
 }
 
 void XAIThreatMap::AddThreat(int tx, int tz, int tr, float v) {
+	if (tr < 0) {
+		return;
+	}
+
+	MarkChanged(XAIMapRect(tx - tr, tz - tr, tx + tr + 1, tz + tr + 1));
+
+	StampDisc(&values[0], mapx, mapy, GetDiscSpans(tr), tx, tz, tr, v);
+}
+
+const std::vector<int>& XAIThreatMap::GetDiscSpans(int tr) {
+	std::vector<int>& spans = discSpans[tr];
+
+	if (spans.empty()) {
+		// for each row j in [-tr, tr], store the largest
+		// i such that (i * i + j * j) <= (tr * tr), ie.
+		// the half-width of the disc's span on that row
+		spans.resize((tr << 1) + 1, 0);
+
+		for (int j = -tr, i = 0; j <= tr; j++) {
+			for (i = tr; ((i * i) + (j * j)) > (tr * tr); i--) {
+			}
+
+			spans[j + tr] = i;
+		}
+	}
+
+	return spans;
+}
+
+
+
+// the original (2r + 1)^2 bounding-square kernel
+static void AddThreatRef(float* values, int mapx, int mapy, int tx, int tz, int tr, float v) {
 	for (int i = -tr; i <= tr; i++) {
 		for (int j = -tr; j <= tr; j++) {
 			if ((tx + i) <     0) { continue; }
@@ -293,47 +947,174 @@ void XAIThreatMap::AddThreat(int tx, int tz, int tr, float v) {
 			if (((i * i) + (j * j)) > (tr * tr))
 				continue;
 
-			const int   k = (tz + j) * mapx + (tx + i);
-			const float w = pixels[k].GetValue();
-			const float d = std::max(w + v, 0.0f);
+			values[(tz + j) * mapx + (tx + i)] += v;
+		}
+	}
+}
+
+// stamps discs of several radii (at the center of the map
+// and clipped by its corners) with both the span kernel and
+// the original one into scratch maps, and returns (and logs)
+// the number of cells on which they differ; the threat-map
+// itself is not touched
+int XAIThreatMap::SelfCheck() {
+	static const int numRadii = 6;
+	static const int radii[numRadii] = {0, 1, 4, 8, 16, 64};
 
-			// d * XAIUtil::GaussDens(i + j, 0.0f, 1.0f);
+	const int xs[3] = {mapx >> 1, 1, mapx - 2};
+	const int zs[3] = {mapy >> 1, 1, mapy - 2};
 
-			pixels[k].SetValue(d);
+	std::vector<float> refValues(mapx * mapy, 0.0f);
+	std::vector<float> newValues(mapx * mapy, 0.0f);
+
+	for (int n = 0; n < numRadii; n++) {
+		const int tr = radii[n];
+
+		for (int k = 0; k < 3; k++) {
+			AddThreatRef(&refValues[0], mapx, mapy, xs[k], zs[k], tr, 1.0f);
+			StampDisc(&newValues[0], mapx, mapy, GetDiscSpans(tr), xs[k], zs[k], tr, 1.0f);
 		}
 	}
+
+	int numDiffs = 0;
+
+	for (int tIdx = (mapx * mapy) - 1; tIdx >= 0; tIdx--) {
+		numDiffs += int(refValues[tIdx] != newValues[tIdx]);
+	}
+
+	LOG_BASIC(
+		xaih->logger,
+		"[XAIThreatMap::SelfCheck][frame=" << xaih->GetCurrFrame() << "]" <<
+		" span stamps differ from the per-cell kernel in " <<
+		numDiffs << " threat-cells"
+	);
+
+	return numDiffs;
 }
 
-float XAIThreatMap::GetThreat(const float3& p) const {
-	const int tx = HEIGHT2THREAT(WORLD2HEIGHT(int(p.x)));
-	const int tz = HEIGHT2THREAT(WORLD2HEIGHT(int(p.z)));
+// enemy threat minus own influence, clamped to zero and
+// computed over the rows of the changed region in one
+// (vectorized) pass each
+void XAIThreatMap::UpdateNetThreat() const {
+	if (netThreatRect.IsEmpty()) {
+		return;
+	}
 
-	if (tx < 0 || tx >= mapx) { return 0.0f; }
-	if (tz < 0 || tz >= mapy) { return 0.0f; }
+	const int xmin = netThreatRect.xmin;
+	const int xmax = netThreatRect.xmax;
 
-	static const int kernelSize = 3;
-	static const int kernelWidth = kernelSize >> 1;
-	static const float kernelWeights[kernelSize][kernelSize] = {
-		{1.0f, 2.0f, 1.0f},
-		{2.0f, 5.0f, 2.0f},
-		{1.0f, 2.0f, 1.0f}
-	};
+	for (int z = netThreatRect.zmin; z < netThreatRect.zmax; z++) {
+		const float* enemy = &values[z * mapx];
+		const float* own   = ownInfluence.GetData() + z * mapx;
+		      float* net   = netThreat.GetData() + z * mapx;
 
-	float threat = 0.0f; // pixels[tz * mapx + tx].GetValue();
+		int x = xmin;
 
-	for (int i = -kernelWidth; i <= kernelWidth; i++) {
-		for (int j = -kernelWidth; j <= kernelWidth; j++) {
-			if ((tx + i) <     0) { continue; }
-			if ((tx + i) >= mapx) { continue; }
-			if ((tz + j) <     0) { continue; }
-			if ((tz + j) >= mapy) { continue; }
+		#ifdef __SSE__
+		const __m128 zero = _mm_setzero_ps();
 
-			const float t = pixels[(tz + j) * mapx + (tx + i)].GetValue();
-			const float w = kernelWeights[i + kernelWidth][j + kernelWidth];
+		for (; (x + 4) <= xmax; x += 4) {
+			_mm_storeu_ps(net + x, _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(enemy + x), _mm_loadu_ps(own + x)), zero));
+		}
+		#endif
+
+		for (; x < xmax; x++) {
+			net[x] = std::max(enemy[x] - own[x], 0.0f);
+		}
+	}
+
+	netThreatRect = XAIMapRect();
+}
+
+void XAIThreatMap::UpdateThreatSAT() const {
+	if (threatSATRow >= mapy) {
+		return;
+	}
+
+	UpdateNetThreat();
+
+	// note: all stamped values are multiples of the
+	// threat quantum, so the sums (and differences of
+	// sums) stored here are exact and an empty region
+	// will always have a sum of exactly zero
+	const int satx = mapx + 1;
+
+	threatSAT.resize(satx * (mapy + 1), 0.0);
 
-			threat += (t * w);
+	// rows above the first changed one keep their sums
+	for (int z = threatSATRow; z < mapy; z++) {
+		const float*  row    = netThreat.GetRow(z);
+		const double* satRow = &threatSAT[(z    ) * satx];
+		      double* satNxt = &threatSAT[(z + 1) * satx];
+
+		double rowSum = 0.0;
+
+		for (int x = 0; x < mapx; x++) {
+			rowSum += row[x];
+			satNxt[x + 1] = satRow[x + 1] + rowSum;
 		}
 	}
 
-	return threat;
+	threatSATRow = mapy;
+}
+
+float XAIThreatMap::GetThreatSum(const XAIMapRect& rect) const {
+	XAIMapRect r = rect;
+	r.ClipTo(mapx, mapy);
+
+	if (r.IsEmpty()) {
+		return 0.0f;
+	}
+
+	UpdateThreatSAT();
+
+	const int satx = mapx + 1;
+	const double s =
+		threatSAT[r.zmax * satx + r.xmax] -
+		threatSAT[r.zmin * satx + r.xmax] -
+		threatSAT[r.zmax * satx + r.xmin] +
+		threatSAT[r.zmin * satx + r.xmin];
+
+	return (std::max(float(s), 0.0f));
+}
+
+float XAIThreatMap::GetThreatAvg(const float3& p, float r) const {
+	const int tx = HEIGHT2THREAT(WORLD2HEIGHT(int(p.x)));
+	const int tz = HEIGHT2THREAT(WORLD2HEIGHT(int(p.z)));
+	const int tr = HEIGHT2THREAT(WORLD2HEIGHT(int(r)));
+
+	XAIMapRect rect(tx - tr, tz - tr, tx + tr + 1, tz + tr + 1);
+	rect.ClipTo(mapx, mapy);
+
+	if (rect.IsEmpty()) {
+		return 0.0f;
+	}
+
+	return (GetThreatSum(rect) / rect.GetArea());
+}
+
+float XAIThreatMap::GetEnemyThreat(const float3& p) const {
+	return (GetValue(HEIGHT2THREAT(WORLD2HEIGHT(int(p.x))), HEIGHT2THREAT(WORLD2HEIGHT(int(p.z)))));
+}
+
+float XAIThreatMap::GetOwnInfluence(const float3& p) const {
+	return (ownInfluence.GetValue(HEIGHT2THREAT(WORLD2HEIGHT(int(p.x))), HEIGHT2THREAT(WORLD2HEIGHT(int(p.z)))));
+}
+
+float XAIThreatMap::GetThreat(const float3& p) const {
+	const int tx = HEIGHT2THREAT(WORLD2HEIGHT(int(p.x)));
+	const int tz = HEIGHT2THREAT(WORLD2HEIGHT(int(p.z)));
+
+	if (tx < 0 || tx >= mapx) { return 0.0f; }
+	if (tz < 0 || tz >= mapy) { return 0.0f; }
+
+	// the {1, 2, 1; 2, 5, 2; 1, 2, 1} kernel as a sum of
+	// SAT rectangles: the 3x3 box, plus its center row and
+	// center column, plus twice the center cell
+	const float box = GetThreatSum(XAIMapRect(tx - 1, tz - 1, tx + 2, tz + 2));
+	const float row = GetThreatSum(XAIMapRect(tx - 1, tz,     tx + 2, tz + 1));
+	const float col = GetThreatSum(XAIMapRect(tx,     tz - 1, tx + 1, tz + 2));
+	const float ctr = GetThreatSum(XAIMapRect(tx,     tz,     tx + 1, tz + 1));
+
+	return (box + row + col + ctr * 2.0f);
 }
@@ -2,40 +2,117 @@
 #define XAI_THREATMAP_HDR
 
 #include <map>
+#include <string>
 #include <vector>
 
 #include "System/float3.h"
 #include "./XAIMap.hpp"
+#include "./XAIMapPyramid.hpp"
 #include "../events/XAIIEventReceiver.hpp"
 
+enum XAIThreatMapUpdateMode {
+	XAI_THREATMAP_UPDATE_FULL        = 0, // rebuild the entire map every frame
+	XAI_THREATMAP_UPDATE_INCREMENTAL = 1, // only re-stamp enemies that changed
+	XAI_THREATMAP_UPDATE_THREADED    = 2, // rebuild a back-buffer on a worker thread
+};
+
 class float3;
 struct XAIIEvent;
 struct XAIHelper;
 struct XAIThreatMap: public XAIMap<float>, public XAIIEventReceiver {
 public:
 	XAIThreatMap(XAIHelper*);
+	~XAIThreatMap();
 
 	void OnEvent(const XAIIEvent*);
 	void AddThreat(int, int, int, float);
-	void AddThreatExt(const float3&, float, float);
 
+	// moves the influence-stamp of one of our own units;
+	// the influence layer is only written when the unit
+	// entered another cell or its radius or power changed
+	void SetInfluence(int unitID, const float3&, float, float);
+	void DelInfluence(int unitID);
+
+	// threat around a world-space position, weighted by the
+	// {1, 2, 1; 2, 5, 2; 1, 2, 1} kernel over its 3x3 cells
 	float GetThreat(const float3&) const;
-	int GetNumEnemies() const { return numUnitIDs; }
-	int GetEnemyID(int i) const { return unitIDs[i]; }
+	// sum of the threat-values inside a rectangle (in threat-cells)
+	float GetThreatSum(const XAIMapRect&) const;
+	// average threat-value within <r> elmos of a world-space position
+	float GetThreatAvg(const float3&, float) const;
+	// largest threat-value inside a rectangle (in threat-cells)
+	float GetMaxThreat(const XAIMapRect& r) const { UpdateNetThreat(); return threatPyramid.GetMax(r); }
+	// true if any threat-value inside a rectangle exceeds <t>
+	bool AnyThreatAbove(const XAIMapRect& r, float t) const { UpdateNetThreat(); return threatPyramid.AnyAbove(r, t); }
+
+	// the queries above all see the net threat (enemy threat
+	// minus own influence, clamped to zero); the raw layers
+	// are kept separately and can be read per threat-cell
+	float GetEnemyThreat(const float3&) const;
+	float GetOwnInfluence(const float3&) const;
+	const XAIMap<float>& GetInfluenceMap() const { return ownInfluence; }
+
+	// changes whenever any threat-value (enemy or own) may
+	// have changed, so consumers can cache derived values
+	unsigned int GetVersion() const { return threatVersion; }
+	// same, but only for changes that may affect GetThreat
+	// in the tile of threat-cells around a position
+	unsigned int GetVersion(const float3&) const;
+
+	// in incremental mode only enemies that appeared, died,
+	// moved to another cell or lost health are re-stamped
+	// per frame; in threaded mode the map is rebuilt on a
+	// worker thread and consumers see the previous frame's
+	// enemies (the mode can be switched at any time)
+	void SetUpdateMode(XAIThreatMapUpdateMode m) { updateMode = m; incResync = true; }
+	XAIThreatMapUpdateMode GetUpdateMode() const { return updateMode; }
+
+	// frames between two debug-overlay updates (0 disables them)
+	void SetDebugOverlayInterval(int n) { overlayInterval = n; }
+
+	// compares the stamping kernel against a reference one,
+	// returns the number of mismatching cells
+	int SelfCheck();
 
 private:
 	void Init();
 	void FastUpdate();
+	void FullUpdate();
+	void ThreadedUpdate();
 	void Update();
+	void DebugCompareUpdate();
+	void UpdateThreatSAT() const;
+	void UpdateNetThreat() const;
+	void UpdateDebugOverlay();
+
+	// returns the half-width of each row of a disc of
+	// radius <r> (in threat-cells), built on first use
+	const std::vector<int>& GetDiscSpans(int r);
 
-	int numUnitIDs;              // number of enemy units present
 	int numUnitDefIDs;           // number of unique UnitDef types
-	std::vector<int> unitIDs;    // IDs of enemy units filled via GetEnemyUnits
 	std::vector<int> unitDefIDs; // unit counts per unique UnitDefID
 
+	// what one enemy-snapshot row contributes to the map,
+	// shared by all update modes so they cannot disagree
+	struct RowStamp {
+		int unitDefID;
+		int tx, tz;     // threat-cell
+		int tr;         // radius (in threat-cells)
+		int hb;         // health-bucket
+		float pwr;      // quantized threat-value
+		float3 pos;
+	};
+
+	void ResetUnitDefCounts();
+	bool GetRowStamp(int row, RowStamp* s, float* pwrSum, float* pwrMax);
+
 	struct EnemyUnit {
-		EnemyUnit(): unitID(-1), unitDefID(-1), pwr(0.0f), pos(ZeroVector) {}
-		EnemyUnit(int uID, int defID, const float3& p): unitID(uID), unitDefID(defID), pwr(0.0f), pos(p) {}
+		EnemyUnit(): unitID(-1), unitDefID(-1), pwr(0.0f), pos(ZeroVector) {
+			tx = -1; tz = -1; tr = 0; hb = -1; frame = 0;
+		}
+		EnemyUnit(int uID, int defID, const float3& p): unitID(uID), unitDefID(defID), pwr(0.0f), pos(p) {
+			tx = -1; tz = -1; tr = 0; hb = -1; frame = 0;
+		}
 
 		bool operator < (const EnemyUnit& u) const {
 			return (unitID < u.unitID);
@@ -44,35 +121,174 @@ private:
 		int unitID;
 		int unitDefID;
 
-		float pwr;      // last-frame health / maxHealth
+		float pwr;      // last-stamped threat-value
 		float3 pos;     // last-frame position
+
+		int tx, tz;     // last-stamped threat-cell
+		int tr;         // last-stamped radius (in threat-cells)
+		int hb;         // last-stamped health-bucket
+		unsigned int frame; // last frame this unit was seen
 	};
 	std::map<int, EnemyUnit> enemyUnits;
 
-	struct ThreatCell {
-		ThreatCell(): N(0) {
-		}
+	// one disc-stamp (in threat-cells) of an own unit's influence
+	struct ThreatStamp {
+		ThreatStamp(int x = -1, int z = -1, int r = -1, float v = 0.0f): tx(x), tz(z), tr(r), tv(v) {}
+
+		int tx, tz, tr;
+		float tv;
+	};
+
+	void StampEnemyUnit(const EnemyUnit&, float);
+	void StampInfluence(const ThreatStamp&, float);
 
-		int GetUnitCount() const { return N; }
-		int GetUnitCount(int unitDefID) const {
-			const std::map<int, int>::const_iterator it = M.find(unitDefID);
+	// per-cell enemy unit-counts (in total and by UnitDef),
+	// rebuilt every update from a flat list of (cell, defID)
+	// records so no cell ever allocates memory of its own
+	struct ThreatCellTable {
+	public:
+		ThreatCellTable(): gen(0) {}
 
-			if (it != M.end()) {
-				return it->second;
-			} else {
+		void Init(int numCells);
+		// O(1), cells with a stale generation count as empty
+		void Clear() { records.clear(); gen = (gen + 1 == 0)? ResetGens(): gen + 1; }
+		void AddUnit(int cell, int unitDefID) { records.push_back(Record(cell, unitDefID)); }
+		void Build();
+		void Swap(ThreatCellTable&);
+
+		int GetUnitCount(int cell) const {
+			return ((cellGens[cell] == gen)? cellUnits[cell]: 0);
+		}
+		int GetUnitCount(int cell, int unitDefID) const {
+			if (cellGens[cell] != gen)
 				return 0;
+
+			for (int i = cellFirst[cell]; i < cellLast[cell]; i++) {
+				if (entries[i].unitDefID == unitDefID) {
+					return entries[i].count;
+				}
 			}
+
+			return 0;
 		}
 
-		int N;
-		std::map<int, int> M;
+	private:
+		unsigned int ResetGens();
+
+		struct Record {
+			Record(int c = 0, int defID = 0): cell(c), unitDefID(defID) {}
+
+			int cell;
+			int unitDefID;
+		};
+		struct Entry {
+			Entry(int defID = 0, int n = 0): unitDefID(defID), count(n) {}
+
+			int unitDefID;
+			int count;
+		};
+
+		std::vector<Record> records; // units added since Clear()
+		std::vector<Record> sorted;  // records counting-sorted by cell
+		std::vector<Entry> entries;  // per-cell runs of (defID, count)
+		std::vector<int> cells;      // cells with at least one unit
+
+		// indexed by cell, only valid if cellGens[cell] == gen
+		std::vector<unsigned int> cellGens;
+		std::vector<int> cellUnits;
+		std::vector<int> cellFirst;
+		std::vector<int> cellLast;
+
+		unsigned int gen;
 	};
-	std::vector<ThreatCell> threatCells;
+	ThreatCellTable threatCells;
+
+	// disc span-tables keyed by radius (map nodes do not
+	// move when new radii are added, so the worker thread
+	// can safely keep using tables built earlier)
+	std::map<int, std::vector<int> > discSpans;
+
+	// an enemy as seen by the worker thread, gathered
+	// on the AI thread with all callback queries done
+	struct EnemyStamp {
+		EnemyStamp(int defID, int x, int z, int r, float v, const std::vector<int>* s):
+			unitDefID(defID), tx(x), tz(z), tr(r), tv(v), spans(s) {
+		}
+
+		int unitDefID;
+		int tx, tz, tr;
+		float tv;
+		const std::vector<int>* spans;
+	};
+
+	// defined in the .cpp so this header does not need boost
+	struct UpdateWorker;
+	friend struct UpdateWorker;
+
+	void RasterizeBackBuffer();
+	void SwapBuffers();
+
+	// owned by the worker thread while a job is pending
+	std::vector<EnemyStamp> backStamps;
+	std::vector<float> backValues;
+	ThreatCellTable backThreatCells;
+
+	float backMaxThreat;
+	float backSumThreat;
+
+	UpdateWorker* updateWorker;
+
+	// positive influence of our own attackers, stamped only
+	// when a unit's stamp changes; ownStamps holds the last
+	// stamp per unitID (tr == -1 if the unit has none)
+	XAIMap<float> ownInfluence;
+	std::vector<ThreatStamp> ownStamps;
+
+	// max(enemy threat - own influence, 0) per cell, fused
+	// by the first query after any change over the bounds
+	// of all changes since the last one (netThreatRect)
+	mutable XAIMap<float> netThreat;
+	mutable XAIMapRect netThreatRect;
+
+	unsigned int threatVersion;
+
+	// value of threatVersion when each tile (of
+	// XAI_THREATMAP_VERSION_TILE^2 threat-cells) last
+	// changed, so per-cell caches survive far-off stamps
+	std::vector<unsigned int> tileVersions;
+	int tilesx, tilesz;
+
+	void MarkChanged(const XAIMapRect&);
+	void MarkAllChanged();
+
+	// summed-area table over the net threat-values
+	// with one extra row and column of zeroes in front,
+	// rebuilt lazily by the first query after any stamp
+	// from the first changed row (threatSATRow) down
+	mutable std::vector<double> threatSAT;
+	mutable int threatSATRow;
+
+	// max- and sum-pyramid over the net threat-values,
+	// stamps mark their bounds dirty and the first query to
+	// follow rebuilds only those tiles
+	mutable XAIMapPyramid<float> threatPyramid;
 
 	float avgThreat;
 	float maxThreat;
 	float sumThreat;
 
+	// per-cell bytes last sent to the Lua overlay, the
+	// bytes for the current values, and the message
+	std::vector<unsigned char> overlayCells;
+	std::vector<unsigned char> overlayDelta;
+	std::string overlayMsg;
+
+	int overlayInterval;
+	int overlayScaleExp;
+
+	XAIThreatMapUpdateMode updateMode;
+	bool incResync;
+
 	XAIHelper* xaih;
 };
 
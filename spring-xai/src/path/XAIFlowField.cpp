@@ -0,0 +1,95 @@
+#include <algorithm>
+#include <cmath>
+
+#include "./XAIFlowField.hpp"
+
+static const int   dirX[8] = {1, -1,  0,  0,  1, -1,  1, -1};
+static const int   dirZ[8] = {0,  0,  1, -1,  1,  1, -1, -1};
+static const float dirC[8] = {1.0f, 1.0f, 1.0f, 1.0f, M_SQRT2, M_SQRT2, M_SQRT2, M_SQRT2};
+// index of the opposite direction
+static const int   dirO[8] = {1,  0,  3,  2,  7,  6,  5,  4};
+
+XAICFlowField::XAICFlowField(int sx, int sz): passBits(NULL), sizex(sx), sizez(sz), goalCell(-1) {
+	costs.resize(sizex * sizez, -1.0f);
+	dirs.resize(sizex * sizez, DIR_NONE);
+}
+
+void XAICFlowField::Init(const std::vector<unsigned int>* bits, int cell) {
+	passBits = bits;
+	goalCell = cell;
+
+	std::fill(costs.begin(), costs.end(), -1.0f);
+	std::fill(dirs.begin(), dirs.end(), (unsigned char) DIR_NONE);
+
+	while (!openQueue.empty()) {
+		openQueue.pop();
+	}
+
+	// an impassable goal can never be reached
+	if (IsPassable(goalCell)) {
+		costs[goalCell] = 0.0f;
+		openQueue.push(QueueItem(0.0f, goalCell));
+	}
+}
+
+int XAICFlowField::Step(int maxCells) {
+	int numCells = 0;
+
+	while (!openQueue.empty() && numCells < maxCells) {
+		const QueueItem item = openQueue.top(); openQueue.pop();
+		const int cell = item.second;
+
+		if (IsSettled(cell) || item.first > costs[cell]) {
+			continue;
+		}
+
+		dirs[cell] |= DIR_SETTLED;
+		numCells += 1;
+
+		const int x = cell % sizex;
+		const int z = cell / sizex;
+
+		for (int d = 0; d < 8; d++) {
+			const int nx = x + dirX[d];
+			const int nz = z + dirZ[d];
+
+			if (nx < 0 || nx >= sizex) { continue; }
+			if (nz < 0 || nz >= sizez) { continue; }
+
+			const int nbr = nz * sizex + nx;
+
+			if (!IsPassable(nbr) || IsSettled(nbr)) {
+				continue;
+			}
+			// no cutting corners on diagonal moves
+			if (d >= 4 && (!IsPassable(z * sizex + nx) || !IsPassable(nz * sizex + x))) {
+				continue;
+			}
+
+			const float g = item.first + dirC[d];
+
+			if (costs[nbr] >= 0.0f && costs[nbr] <= g) {
+				continue;
+			}
+
+			// moves are symmetric, so the neighbor's first
+			// step toward the goal is back to this cell
+			costs[nbr] = g;
+			dirs[nbr] = dirO[d];
+
+			openQueue.push(QueueItem(g, nbr));
+		}
+	}
+
+	return numCells;
+}
+
+int XAICFlowField::GetNextCell(int cell) const {
+	const int d = dirs[cell] & ~DIR_SETTLED;
+
+	if (d == DIR_NONE) {
+		return -1;
+	}
+
+	return ((cell / sizex + dirZ[d]) * sizex + (cell % sizex + dirX[d]));
+}
@@ -0,0 +1,56 @@
+#ifndef XAI_FLOWFIELD_HDR
+#define XAI_FLOWFIELD_HDR
+
+#include <functional>
+#include <queue>
+#include <utility>
+#include <vector>
+
+// flow-field toward one goal cell over a grid of passable
+// cells (one bit per cell, see XAICPathFinder::GetPassGrid):
+// the integration field holds the cost (in cells) of the
+// shortest path from every cell to the goal, the direction
+// field the first step of that path; both are filled by a
+// Dijkstra from the goal that can be spread over frames
+// (cells are settled in order of their cost, so the ones
+// near the goal are usable before the field is complete)
+class XAICFlowField {
+public:
+	XAICFlowField(int sx, int sz);
+
+	void Init(const std::vector<unsigned int>* bits, int goalCell);
+	// settles at most <maxCells> cells, returns how many it did
+	int Step(int maxCells);
+
+	bool IsDone() const { return openQueue.empty(); }
+	bool IsSettled(int cell) const { return ((dirs[cell] & DIR_SETTLED) != 0); }
+
+	int GetGoalCell() const { return goalCell; }
+	// only valid for settled cells
+	float GetCost(int cell) const { return costs[cell]; }
+	// next cell on the way to the goal (-1 for the goal)
+	int GetNextCell(int cell) const;
+
+private:
+	enum {
+		DIR_NONE    = 0x0F,
+		DIR_SETTLED = 0x80,
+	};
+
+	bool IsPassable(int cell) const {
+		return ((((*passBits)[cell >> 5] >> (cell & 31)) & 1) != 0);
+	}
+
+	const std::vector<unsigned int>* passBits;
+
+	int sizex, sizez;
+	int goalCell;
+
+	std::vector<float> costs;        // -1 until reached
+	std::vector<unsigned char> dirs; // DIR_SETTLED | index into the direction tables
+
+	typedef std::pair<float, int> QueueItem;
+	std::priority_queue<QueueItem, std::vector<QueueItem>, std::greater<QueueItem> > openQueue;
+};
+
+#endif
@@ -1,19 +1,96 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <set>
 #include <sstream>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
 #include "LegacyCpp/IAICallback.h"
 #include "System/float3.h"
 
 #include "./XAIPathFinder.hpp"
+#include "./XAIFlowField.hpp"
+#include "./XAIPathGraph.hpp"
+#include "./XAIPathLengthCache.hpp"
 #include "./XAIIPathNode.hpp"
+#include "../events/XAIIEvent.hpp"
 #include "../map/XAIMap.hpp"
 #include "../map/XAIMaskMap.hpp"
+#include "../map/XAIThreatMap.hpp"
 #include "../main/XAIHelper.hpp"
 #include "../main/XAIConstants.hpp"
+#include "../main/XAIFolders.hpp"
 #include "../units/XAIUnit.hpp"
 #include "../units/XAIUnitDef.hpp"
 #include "../units/XAIUnitDefHandler.hpp"
 #include "../groups/XAIGroup.hpp"
+#include "../utils/XAILogger.hpp"
+#include "../utils/XAIRNG.hpp"
 #include "../utils/XAITimer.hpp"
+#include "../utils/XAIUtil.hpp"
+
+// masks are never made at startup: a key is queued by its
+// first IsPathPossible query, after which UpdateMasks reads
+// its cache-file and writes it back (at most one such step
+// per XAI_MASKMAP_FRAME_BUDGET microseconds each frame)
+// and XAI_MASKMAP_THREADS pool threads (0: one per core)
+// label the masks in the background; with only one thread
+// they are labelled on the AI thread instead, in slices of
+// XAI_MASKMAP_STEP_PIXELS pixels within the frame budget
+#define XAI_MASKMAP_THREADS 0
+#define XAI_MASKMAP_FRAME_BUDGET 2000
+#define XAI_MASKMAP_STEP_PIXELS 16384
+// bump whenever the labelling or the file layout changes
+#define XAI_MASKCACHE_VERSION 2
+// if 1, searches longer than XAI_PATHGRAPH_MIN_DIST (octile
+// distance in slope-map cells) go over the abstract graph
+// with clusters of XAI_PATHGRAPH_CLUSTER_SIZE^2 cells
+#define XAI_PATHGRAPH 1
+#define XAI_PATHGRAPH_MIN_DIST 64
+#define XAI_PATHGRAPH_CLUSTER_SIZE 16
+// random far-apart queries per graph run by SelfCheck
+#define XAI_PATHGRAPH_SELFCHECK_QUERIES 100
+// path-length cache: entries, expiry (in frames), and
+// start-cell quantization (in slope-map cells)
+#define XAI_PATHCACHE_CAPACITY 4096
+#define XAI_PATHCACHE_TTL (GAME_SPEED * 30)
+#define XAI_PATHCACHE_START_QUANT 4
+// flow-fields kept at once, cells settled per frame (over
+// all fields), and cells between a position and the next
+// waypoint returned for it
+#define XAI_FLOWFIELD_CACHE_SIZE 8
+#define XAI_FLOWFIELD_FRAME_CELLS 32768
+#define XAI_FLOWFIELD_WAYPOINT_STEPS 8
+// region-IDs are 16-bit, all regions past the last ID
+// share it (so it does not prove two cells connected)
+#define XAI_REGION_ID_MAX 0xFFFF
+// the height-map is diffed in tiles of this many pixels
+// squared, this many tiles per frame (so the whole map is
+// checked every few seconds)
+#define XAI_TERRAIN_TILE_SIZE 32
+#define XAI_TERRAIN_TILES_PER_FRAME 16
+// goals on impassable cells (eg. metal spots on steep
+// ground) stand for the nearest passable cell at most
+// this many slope-map cells away
+#define XAI_GOAL_SNAP_RADIUS 4
 
 XAICPathFinder::XAICPathFinder(XAIHelper* h): xaih(h) {
 	XAICScopedTimer t("[XAICPathFinder::XAICPathFinder]", xaih->timer);
@@ -32,14 +109,28 @@ XAICPathFinder::XAICPathFinder(XAIHelper* h): xaih(h) {
 	xaiHeightMap->Copy(sprHeightMap);
 	xaiSlopeMap->Copy(sprSlopeMap);
 
+	// the slope-map is derived from the height-map,
+	// so this identifies both for the mask-cache
+	heightMapHash = XAI_HASH_SEED;
+	heightMapHash = XAIUtil::HashBytes(heightMapHash, &hmapx, sizeof(hmapx));
+	heightMapHash = XAIUtil::HashBytes(heightMapHash, &hmapy, sizeof(hmapy));
+	heightMapHash = XAIUtil::HashBytes(heightMapHash, sprHeightMap, hmapx * hmapy * sizeof(float));
 
-	nodes.resize(hmapx * hmapy, NULL);
+	// search-state for A* (one entry per slope-map cell)
+	nodeCosts.resize(smapx * smapy, 0.0f);
+	nodeParents.resize(smapx * smapy, -1);
+	nodeGens.resize(smapx * smapy, 0);
+	nodeStates.resize(smapx * smapy, 0);
+	searchGen = 0;
 
-	// initialize the node-map
-	for (int i = 0; i < (hmapx * hmapy); i += 2) {
-		nodes[i    ] = new XAIIPathNode(i    );
-		nodes[i + 1] = new XAIIPathNode(i + 1);
-	}
+	cellThreats.resize(smapx * smapy, 0.0f);
+	cellThreatVers.resize(smapx * smapy, 0);
+
+	pathLengthCache = new XAICPathLengthCache(smapx, smapy, XAI_PATHCACHE_START_QUANT, XAI_PATHCACHE_CAPACITY, XAI_PATHCACHE_TTL);
+	flowUseCounter = 0;
+
+	terrainTile = 0;
+	terrainChanged = false;
 
 	// retrieve the unique MoveData's
 	for (int id = 1; id <= xaih->rcb->GetNumUnitDefs(); id++) {
@@ -67,71 +158,526 @@ XAICPathFinder::XAICPathFinder(XAIHelper* h): xaih(h) {
 		}
 	}
 
-	// generate the MoveData masks (too slow)
-	//    spread over multiple frames and/or
-	//    change flood-fill to use scanlines and/or
-	//    make threaded and/or
-	//    do lazy-loading and/or
-	//    cache the mask-maps (a la Spring) and/or
-	//    look for MD's with equal maxSlope / maxDepth
-	//    precompute pixel filter values in XAIMap<bool>'s
+	// one mask-map per distinct key (many pathTypes only
+	// differ in parameters the pixel filter ignores)
 	// NOTE:
 	//    flood-filled regions are not necessarily convex!
 	//    (thus two points within the same region are not
 	//    necessarily connected by a straight line)
-	/*
+	std::map<XAIMoveDataKey, int> keyEntryIDs;
+
 	for (std::map<int, const MoveData*>::const_iterator it = moveDataMap.begin(); it != moveDataMap.end(); it++) {
-		std::stringstream ss("");
-			ss.width(2);
-			ss << "[XAICPathFinder::XAICPathFinder]";
-			ss << "[MaskMap(" << it->first << ")]";
-		std::string s = ss.str();
+		const XAIMoveDataKey key(it->second);
 
-		XAICScopedTimer st(s.c_str(), xaih->timer);
+		std::map<XAIMoveDataKey, int>::const_iterator kit = keyEntryIDs.find(key);
+
+		if (kit != keyEntryIDs.end()) {
+			maskEntryIDs[it->first] = kit->second;
+			continue;
+		}
 
 		XAIIMapPixelFilter<float>* mpf = new XAIMapPixelHeightSlopeFilter<float>(it->second);
 		XAIMaskMap<float>* maskMap = new XAIMaskMap<float>();
 			maskMap->AddMap(xaiHeightMap);
 			maskMap->AddMap(xaiSlopeMap);
 			maskMap->SetMapPixelFilter(mpf);
-			maskMap->GenerateMasks();
-		maskMaps[it->first] = maskMap;
-		delete mpf;
+
+		keyEntryIDs[key] = maskEntries.size();
+		maskEntryIDs[it->first] = maskEntries.size();
+		maskEntries.push_back(MaskEntry(maskMap, mpf, it->second));
+	}
+
+	maskFrameBudget = XAI_MASKMAP_FRAME_BUDGET;
+	maskJobs = NULL;
+	maskThreads = XAI_MASKMAP_THREADS;
+
+	if (maskThreads == 0) {
+		maskThreads = std::max(1U, boost::thread::hardware_concurrency());
 	}
-	*/
 }
 
-XAICPathFinder::~XAICPathFinder() {
-	for (int i = 0; i < nodes.size(); i += 2) {
-		delete nodes[i    ];
-		delete nodes[i + 1];
+void XAICPathFinder::OnEvent(const XAIIEvent* e) {
+	switch (e->type) {
+		case XAI_EVENT_UPDATE: {
+			UpdateTerrain();
+			UpdateMasks();
+			UpdateFlowFields();
+		} break;
+		case XAI_EVENT_RELEASE: {
+			xaih->timer->SetCounter("[XAICPathLengthCache::hits]", pathLengthCache->GetNumHits());
+			xaih->timer->SetCounter("[XAICPathLengthCache::misses]", pathLengthCache->GetNumMisses());
+		} break;
+
+		default: {
+		} break;
+	}
+}
+
+// returns true if the masks of entry <n> are available,
+// otherwise queues the entry (so that UpdateMasks loads
+// or generates them over the next frames)
+bool XAICPathFinder::RequestMasks(int n) {
+	MaskEntry& e = maskEntries[n];
+
+	if (e.ready ) { return true;  }
+	if (e.queued) { return false; }
+
+	e.queued = true;
+	maskQueue.push_back(n);
+	return false;
+}
+
+// advances every queued entry by one step while within
+// maskFrameBudget microseconds (the last step may overrun
+// it): reading the cache, handing the entry to the pool
+// (or labelling a slice of it without one), or writing
+// the cache; entries on the pool only wait for it
+void XAICPathFinder::UpdateMasks() {
+	if (maskQueue.empty()) {
+		return;
+	}
+
+	XAICScopedTimer t("[XAICPathFinder::UpdateMasks]", xaih->timer);
+
+	if (maskJobs != NULL && FinishMaskJobs(false)) {
+		for (std::list<int>::const_iterator it = maskQueue.begin(); it != maskQueue.end(); ++it) {
+			MaskEntry& e = maskEntries[*it];
+
+			if (e.maskStep != MASK_STEP_WAIT) {
+				continue;
+			}
+
+			// usable before they are stored
+			e.ready    = true;
+			e.maskStep = MASK_STEP_WRITE;
+		}
+	}
+
+	const boost::posix_time::ptime t0 = boost::posix_time::microsec_clock::universal_time();
+
+	for (std::list<int>::iterator it = maskQueue.begin(); it != maskQueue.end(); ) {
+		const boost::posix_time::ptime t1 = boost::posix_time::microsec_clock::universal_time();
+
+		if ((t1 - t0).total_microseconds() >= maskFrameBudget) {
+			break;
+		}
+
+		MaskEntry& e = maskEntries[*it];
+
+		switch (e.maskStep) {
+			case MASK_STEP_READ: {
+				if (ReadMaskCache(e.maskMap, XAIMoveDataKey(e.moveData))) {
+					e.ready    = true;
+					e.maskStep = MASK_STEP_DONE;
+				} else {
+					e.maskStep = MASK_STEP_LABEL;
+				}
+			} break;
+			case MASK_STEP_LABEL: {
+				if (maskThreads > 1) {
+					// everything waiting for labels goes to the
+					// pool at once, once it is free again
+					if (maskJobs == NULL) {
+						StartMaskJobs();
+					}
+
+					break;
+				}
+
+				if (!e.maskMap->GenerateMasksStep(XAI_MASKMAP_STEP_PIXELS)) {
+					break;
+				}
+
+				e.ready    = true;
+				e.maskStep = MASK_STEP_WRITE;
+			} break;
+			case MASK_STEP_WRITE: {
+				WriteMaskCache(e.maskMap, XAIMoveDataKey(e.moveData));
+
+				e.maskStep = MASK_STEP_DONE;
+			} break;
+			default: {
+			} break;
+		}
+
+		if (e.maskStep == MASK_STEP_DONE) {
+			e.queued = false;
+			it = maskQueue.erase(it);
+		} else {
+			++it;
+		}
+	}
+}
+
+// labelling jobs handed to the pool threads, which take
+// them in order until none are left
+struct XAICPathFinder::MaskJobBatch {
+	MaskJobBatch(): nextJob(0), numDone(0) {}
+
+	std::vector<MaskJob> jobs;
+	unsigned int nextJob;
+	unsigned int numDone;
+
+	boost::mutex mutex;
+	boost::thread_group threads;
+};
+
+// larger layers first, so that no thread is left with
+// a big job when all others have run out of work
+static bool MaskJobCmp(const XAICPathFinder::MaskJob& a, const XAICPathFinder::MaskJob& b) {
+	return (a.maskMap->GetMaps()[a.layer]->GetArea() > b.maskMap->GetMaps()[b.layer]->GetArea());
+}
+
+// runs by each pool thread until all jobs are taken
+void XAICPathFinder::RunMaskJobs(MaskJobBatch* batch) {
+	while (true) {
+		unsigned int j = 0;
+
+		{
+			boost::mutex::scoped_lock lock(batch->mutex);
+			j = (batch->nextJob)++;
+		}
+
+		if (j >= batch->jobs.size()) {
+			return;
+		}
+
+		(batch->jobs[j].maskMap)->GenerateMask(batch->jobs[j].layer);
+
+		{
+			boost::mutex::scoped_lock lock(batch->mutex);
+			batch->numDone += 1;
+		}
+	}
+}
+
+// hands every layer of every queued entry that still needs
+// labels to the pool; each job labels its layer exactly as
+// XAIMaskMap::GenerateMasks would, so the labels do not
+// depend on the number of threads or the job order
+//
+// the pool only reads the height- and slope-maps, and they
+// are not written to (see UpdateTerrain) until it is done
+void XAICPathFinder::StartMaskJobs() {
+	maskJobs = new MaskJobBatch();
+
+	for (std::list<int>::const_iterator it = maskQueue.begin(); it != maskQueue.end(); ++it) {
+		MaskEntry& e = maskEntries[*it];
+
+		if (e.maskStep != MASK_STEP_LABEL) {
+			continue;
+		}
+
+		e.maskMap->AllocMasks();
+		e.maskStep = MASK_STEP_WAIT;
+
+		for (unsigned int i = 0; i < e.maskMap->GetMaps().size(); i++) {
+			maskJobs->jobs.push_back(MaskJob(e.maskMap, i));
+		}
+	}
+
+	std::stable_sort(maskJobs->jobs.begin(), maskJobs->jobs.end(), MaskJobCmp);
+
+	const unsigned int numThreads = std::min(maskThreads, (unsigned int) maskJobs->jobs.size());
+
+	for (unsigned int i = 0; i < numThreads; i++) {
+		maskJobs->threads.create_thread(boost::bind(&XAICPathFinder::RunMaskJobs, maskJobs));
+	}
+}
+
+// returns true (and releases the pool's batch) once all
+// of its jobs are done, or waits for that if <wait> is set
+bool XAICPathFinder::FinishMaskJobs(bool wait) {
+	if (maskJobs == NULL) {
+		return true;
+	}
+
+	if (!wait) {
+		boost::mutex::scoped_lock lock(maskJobs->mutex);
+
+		if (maskJobs->numDone < maskJobs->jobs.size()) {
+			return false;
+		}
+	}
+
+	maskJobs->threads.join_all();
+
+	delete maskJobs;
+	maskJobs = NULL;
+	return true;
+}
+
+
+
+// mask-cache files are laid out as a MaskCacheHeader,
+// followed for each of the header's numMasks masks by
+// its x- and y-size and then the x * y labels (all in
+// native byte-order, the cache is not meant to travel)
+//
+// the hashes only pick the file name, a load compares
+// the raw move-data and map dimensions so that a hash
+// collision can never restore another key's masks
+struct MaskCacheHeader {
+	char magic[4];
+	unsigned int version;
+	unsigned int mapHash;
+	unsigned int keyHash;
+	unsigned int numMasks;
+
+	int   moveType;
+	float depth;
+	float maxSlope;
+	int   hmapx;
+	int   hmapy;
+};
+
+std::string XAICPathFinder::GetMaskCacheName(const XAIMoveDataKey& key) const {
+	std::stringstream ss;
+		ss << XAI_MSK_DIR << XAIUtil::StringStripSpaces(xaih->rcb->GetMapName());
+		ss << "-" << std::hex << heightMapHash;
+		ss << "-" << std::hex << key.GetHash() << ".msk";
+
+	return (XAIUtil::GetAbsFileName(xaih->rcb, ss.str()));
+}
+
+bool XAICPathFinder::ReadMaskCache(XAIMaskMap<float>* maskMap, const XAIMoveDataKey& key) const {
+	// the cache holds masks of the undeformed map
+	if (terrainChanged) {
+		return false;
+	}
+
+	XAICScopedTimer t("[XAICPathFinder::ReadMaskCache]", xaih->timer);
+
+	const std::string fn = GetMaskCacheName(key);
+
+	const char* data = NULL;
+	size_t size = 0;
+
+	#ifndef _WIN32
+	const int fd = open(fn.c_str(), O_RDONLY);
+
+	if (fd == -1) {
+		return false;
+	}
+
+	struct stat fst;
+
+	if (fstat(fd, &fst) != 0 || fst.st_size < off_t(sizeof(MaskCacheHeader))) {
+		close(fd); return false;
+	}
+
+	void* mem = mmap(NULL, fst.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+	// the mapping stays valid after the descriptor is closed
+	close(fd);
+
+	if (mem == MAP_FAILED) {
+		return false;
+	}
+
+	data = (const char*) mem;
+	size = fst.st_size;
+	#else
+	std::ifstream fs(fn.c_str(), std::ios::in | std::ios::binary);
+
+	if (!fs.good()) {
+		return false;
+	}
+
+	std::vector<char> buf((std::istreambuf_iterator<char>(fs)), std::istreambuf_iterator<char>());
+
+	if (buf.empty()) {
+		return false;
+	}
+
+	data = &buf[0];
+	size = buf.size();
+	#endif
+
+	const std::vector<const XAIMap<float>* >& maps = maskMap->GetMaps();
+
+	MaskCacheHeader hdr;
+	memcpy(&hdr, data, std::min(size, sizeof(hdr)));
+
+	bool valid =
+		(size >= sizeof(hdr)) &&
+		(memcmp(hdr.magic, "XMSK", 4) == 0) &&
+		(hdr.version  == XAI_MASKCACHE_VERSION) &&
+		(hdr.mapHash  == heightMapHash) &&
+		(hdr.keyHash  == key.GetHash()) &&
+		(hdr.numMasks == maps.size()) &&
+		(hdr.moveType == key.GetMoveType()) &&
+		(hdr.depth    == key.GetDepth()) &&
+		(hdr.maxSlope == key.GetMaxSlope()) &&
+		(hdr.hmapx    == xaih->rcb->GetMapWidth()) &&
+		(hdr.hmapy    == xaih->rcb->GetMapHeight());
+
+	// check all sizes before restoring anything
+	for (size_t i = 0, ofs = sizeof(hdr); valid && i < maps.size(); i++) {
+		int sizes[2] = {0, 0};
+
+		if ((ofs + sizeof(sizes)) > size) {
+			valid = false; break;
+		}
+
+		memcpy(sizes, data + ofs, sizeof(sizes));
+		ofs += sizeof(sizes);
+
+		valid = valid && (sizes[0] == maps[i]->GetSizeX());
+		valid = valid && (sizes[1] == maps[i]->GetSizeY());
+		valid = valid && ((ofs + maps[i]->GetArea() * sizeof(int)) <= size);
+
+		ofs += maps[i]->GetArea() * sizeof(int);
+	}
+
+	for (size_t i = 0, ofs = sizeof(hdr); valid && i < maps.size(); i++) {
+		ofs += (2 * sizeof(int));
+
+		// labels are int-aligned (everything before them is)
+		maskMap->AddMask((const int*) (data + ofs));
+
+		ofs += maps[i]->GetArea() * sizeof(int);
+	}
+
+	#ifndef _WIN32
+	munmap((void*) data, size);
+	#endif
+
+	return valid;
+}
+
+void XAICPathFinder::WriteMaskCache(const XAIMaskMap<float>* maskMap, const XAIMoveDataKey& key) const {
+	if (terrainChanged) {
+		return;
+	}
+
+	XAICScopedTimer t("[XAICPathFinder::WriteMaskCache]", xaih->timer);
+
+	const std::string fn = GetMaskCacheName(key);
+	const std::string tmpFn = fn + ".tmp";
+	const std::vector< XAIMap<int>* >& masks = maskMap->GetMasks();
+
+	MaskCacheHeader hdr;
+		memcpy(hdr.magic, "XMSK", 4);
+		hdr.version  = XAI_MASKCACHE_VERSION;
+		hdr.mapHash  = heightMapHash;
+		hdr.keyHash  = key.GetHash();
+		hdr.numMasks = masks.size();
+		hdr.moveType = key.GetMoveType();
+		hdr.depth    = key.GetDepth();
+		hdr.maxSlope = key.GetMaxSlope();
+		hdr.hmapx    = xaih->rcb->GetMapWidth();
+		hdr.hmapy    = xaih->rcb->GetMapHeight();
+
+	// write to a temporary file first so that another AI
+	// instance never sees (and loads) a half-written one
+	std::ofstream fs(tmpFn.c_str(), std::ios::out | std::ios::binary);
+
+	fs.write((const char*) &hdr, sizeof(hdr));
+
+	for (unsigned int i = 0; i < masks.size(); i++) {
+		const int sizes[2] = {masks[i]->GetSizeX(), masks[i]->GetSizeY()};
+
+		fs.write((const char*) sizes, sizeof(sizes));
+		fs.write((const char*) masks[i]->GetData(), masks[i]->GetArea() * sizeof(int));
+	}
+
+	const bool ok = fs.good();
+
+	fs.close();
+
+	if (ok) {
+		std::rename(tmpFn.c_str(), fn.c_str());
+	} else {
+		std::remove(tmpFn.c_str());
+	}
+}
+
+
+
+// relabels every mask of every ready entry with the
+// reference flood-fill and logs the number of pixels on
+// which the labels differ (entries that are still queued
+// or stale are skipped), then checks every abstract graph
+// built so far; returns the sum of all mismatches
+int XAICPathFinder::SelfCheck() {
+	std::set<const XAIMaskMap<float>*> checked;
+
+	int numMaskDiffs = 0;
+	int numPathDiffs = 0;
+
+	for (unsigned int n = 0; n < maskEntries.size(); n++) {
+		if (maskEntries[n].pathGraph != NULL) {
+			numPathDiffs += CheckPathGraph(n);
+		}
+
+		const MaskEntry& e = maskEntries[n];
+
+		if (!e.ready || e.masksStale || !checked.insert(e.maskMap).second) {
+			continue;
+		}
+
+		const std::vector< XAIMap<int>* >& masks = e.maskMap->GetMasks();
+
+		for (unsigned int i = 0; i < masks.size(); i++) {
+			XAIMap<int>* refMask = e.maskMap->GenerateMaskRef(i);
+
+			for (int idx = refMask->GetArea() - 1; idx >= 0; idx--) {
+				numMaskDiffs += int(refMask->GetValue(idx) != masks[i]->GetValue(idx));
+			}
+
+			delete refMask;
+		}
 	}
 
-	nodes.clear();
+	LOG_BASIC(
+		xaih->logger,
+		"[XAICPathFinder::SelfCheck][frame=" << xaih->GetCurrFrame() << "]" <<
+		" mask labels differ from the reference flood-fill in " <<
+		numMaskDiffs << " pixels (" << checked.size() << " mask-maps)"
+	);
+
+	return (numMaskDiffs + numPathDiffs);
+}
+
+XAICPathFinder::~XAICPathFinder() {
+	// the pool still reads the maps and writes the masks
+	FinishMaskJobs(true);
 
 	delete xaiHeightMap;
 	delete xaiSlopeMap;
+	delete pathLengthCache;
 
-	for (std::map<int, const MoveData*>::const_iterator it = moveDataMap.begin(); it != moveDataMap.end(); it++) {
-		delete maskMaps[it->first];
+	for (unsigned int i = 0; i < flowEntries.size(); i++) {
+		delete flowEntries[i].field;
+	}
+
+	// mask-maps can be shared by several pathTypes
+	for (unsigned int i = 0; i < maskEntries.size(); i++) {
+		delete maskEntries[i].maskMap;
+		delete maskEntries[i].maskFilter;
+		delete maskEntries[i].pathGraph;
 	}
 
+	maskEntries.clear();
+	maskEntryIDs.clear();
+	maskQueue.clear();
 	moveDataMap.clear();
 }
 
 
 
-bool XAICPathFinder::IsPathPossible(const XAIGroup* g, const float3& wStart, const float3& wGoal) const {
+XAIPathQueryResult XAICPathFinder::IsPathPossible(const XAIGroup* g, const float3& wStart, const float3& wGoal) {
 	if (g->GetUnitCount() == 0) {
-		return false;
+		return XAI_PATH_IMPOSSIBLE;
 	}
 	if (!g->IsMobile()) {
-		return false;
+		return XAI_PATH_IMPOSSIBLE;
 	}
 
 	// float3::IsInBounds appears to be broken AI-side
-	if ((wStart.x < 0.0f) || (wStart.x >= xaih->rcb->GetMapWidth()  * SQUARE_SIZE)) { return false; }
-	if ((wStart.z < 0.0f) || (wStart.z >= xaih->rcb->GetMapHeight() * SQUARE_SIZE)) { return false; }
+	if ((wStart.x < 0.0f) || (wStart.x >= xaih->rcb->GetMapWidth()  * SQUARE_SIZE)) { return XAI_PATH_IMPOSSIBLE; }
+	if ((wStart.z < 0.0f) || (wStart.z >= xaih->rcb->GetMapHeight() * SQUARE_SIZE)) { return XAI_PATH_IMPOSSIBLE; }
 
 	const XAICUnit*   u  = g->GetLeadUnitMember();
 	const XAIUnitDef* ud = u->GetUnitDefPtr();
@@ -139,20 +685,54 @@ bool XAICPathFinder::IsPathPossible(const XAIGroup* g, const float3& wStart, con
 
 	if (md == NULL) {
 		// aircraft groups should not need to use the PF
-		return true;
+		return XAI_PATH_POSSIBLE;
+	}
+
+	std::map<int, int>::const_iterator it = maskEntryIDs.find(md->pathType);
+
+	if (it == maskEntryIDs.end()) {
+		return XAI_PATH_IMPOSSIBLE;
+	}
+
+	if (maskEntries[it->second].masksStale) {
+		const std::vector<unsigned short>& regionIDs = GetRegionIDs(it->second);
+
+		// same goal-cell as IsPathPossibleBatch would use
+		const int goalCell = GetGoalCell(maskEntries[it->second].passBits, wGoal);
+		const unsigned short startID = GetStartRegionID(regionIDs, wStart);
+
+		if (goalCell == -1 || startID == 0 || startID != regionIDs[goalCell]) {
+			return XAI_PATH_IMPOSSIBLE;
+		}
+
+		// regions past the last ID all share it
+		if (startID == XAI_REGION_ID_MAX) {
+			return ((FindPath(md->pathType, wStart, wGoal, NULL) >= 0.0f)? XAI_PATH_POSSIBLE: XAI_PATH_IMPOSSIBLE);
+		}
+
+		return XAI_PATH_POSSIBLE;
+	}
+
+	if (!RequestMasks(it->second)) {
+		return XAI_PATH_PENDING;
 	}
 
-	std::map<int, XAIMaskMap<float>* >::const_iterator it = maskMaps.find(md->pathType);
+	// a goal on an impassable pixel (eg. a geothermal vent)
+	// stands for the passable cell GetGoalCell moves it to
+	const int goalCell = GetGoalCell(GetPassGrid(it->second), wGoal);
 
-	if (it == maskMaps.end()) {
-		return false; // lazy-loading?
+	if (goalCell == -1) {
+		return XAI_PATH_IMPOSSIBLE;
 	}
 
-	const XAIMaskMap<float>* maskMap = it->second;
+	const int xGoalCell = goalCell % xaiSlopeMap->GetSizeX();
+	const int zGoalCell = goalCell / xaiSlopeMap->GetSizeX();
+
+	const XAIMaskMap<float>* maskMap = maskEntries[it->second].maskMap;
 	const std::vector<const XAIMap<float>* >& maps = maskMap->GetMaps();
 	const std::vector< XAIMap<int>* >& masks = maskMap->GetMasks();
 
-	bool ret = false;
+	bool ret = true;
 
 	for (int i = 0; i < maps.size(); i++) {
 		const XAIMap<float>* map = maps[i];
@@ -160,14 +740,15 @@ bool XAICPathFinder::IsPathPossible(const XAIGroup* g, const float3& wStart, con
 
 		switch (map->GetType()) {
 			case XAI_HEIGHT_MAP: {
-				// convert start and goal to HM-space
+				// convert start and goal to HM-space (the goal
+				// cell's passability includes its top-left pixel)
 				const int xS = WORLD2HEIGHT(int(wStart.x));
 				const int zS = WORLD2HEIGHT(int(wStart.z));
-				const int xG = WORLD2HEIGHT(int(wGoal.x));
-				const int zG = WORLD2HEIGHT(int(wGoal.z));
+				const int xG = SLOPE2HEIGHT(xGoalCell);
+				const int zG = SLOPE2HEIGHT(zGoalCell);
 
-				const int maskS = (mask->GetConstPixel(xS, zS))->GetValue();
-				const int maskG = (mask->GetConstPixel(xG, zG))->GetValue();
+				const int maskS = mask->GetValue(xS, zS);
+				const int maskG = mask->GetValue(xG, zG);
 
 				ret = ret && (maskS == maskG);
 			} break;
@@ -175,11 +756,11 @@ bool XAICPathFinder::IsPathPossible(const XAIGroup* g, const float3& wStart, con
 				// convert start and goal to SM-space
 				const int xS = WORLD2SLOPE(int(wStart.x));
 				const int zS = WORLD2SLOPE(int(wStart.z));
-				const int xG = WORLD2SLOPE(int(wGoal.x));
-				const int zG = WORLD2SLOPE(int(wGoal.z));
+				const int xG = xGoalCell;
+				const int zG = zGoalCell;
 
-				const int maskS = (mask->GetConstPixel(xS, zS))->GetValue();
-				const int maskG = (mask->GetConstPixel(xG, zG))->GetValue();
+				const int maskS = mask->GetValue(xS, zS);
+				const int maskG = mask->GetValue(xG, zG);
 
 				ret = ret && (maskS == maskG);
 			} break;
@@ -188,5 +769,1331 @@ bool XAICPathFinder::IsPathPossible(const XAIGroup* g, const float3& wStart, con
 		}
 	}
 
-	return ret;
+	return (ret? XAI_PATH_POSSIBLE: XAI_PATH_IMPOSSIBLE);
+}
+
+
+
+int XAICPathFinder::IsPathPossibleBatch(const XAIGroup* g, const std::vector<float3>& goals, std::vector<unsigned char>* out) {
+	const int numGoals = goals.size();
+
+	out->clear();
+	out->resize(numGoals, 0);
+
+	if (g->GetUnitCount() == 0) { return 0; }
+	if (!g->IsMobile()) { return 0; }
+
+	const XAICUnit*   u  = g->GetLeadUnitMember();
+	const XAIUnitDef* ud = u->GetUnitDefPtr();
+	const MoveData*   md = ud->GetMoveData();
+
+	if (md == NULL) {
+		std::fill(out->begin(), out->end(), 1);
+		return numGoals;
+	}
+
+	std::map<int, int>::const_iterator it = maskEntryIDs.find(md->pathType);
+
+	if (it == maskEntryIDs.end()) {
+		return 0;
+	}
+
+	const std::vector<unsigned short>& regionIDs = GetRegionIDs(it->second);
+	const std::vector<unsigned int>& passBits = maskEntries[it->second].passBits;
+	const unsigned short startID = GetStartRegionID(regionIDs, g->GetPos());
+
+	// impassable goals are in region 0, as is the start if
+	// it cannot be left, so nothing matches that region
+	if (startID == 0) {
+		return 0;
+	}
+
+	#ifdef __SSE2__
+	const __m128i startIDs = _mm_set1_epi16(short(startID));
+	#endif
+
+	unsigned short goalIDs[8];
+	int numPossible = 0;
+
+	// gather the IDs of eight goals, then compare them
+	// against the start's ID all at once
+	for (int i = 0; i < numGoals; i += 8) {
+		const int n = std::min(8, numGoals - i);
+
+		for (int j = 0; j < 8; j++) {
+			if (j >= n) {
+				goalIDs[j] = 0; continue;
+			}
+
+			const int cell = GetGoalCell(passBits, goals[i + j]);
+
+			goalIDs[j] = ((cell != -1)? regionIDs[cell]: 0);
+		}
+
+		#ifdef __SSE2__
+		// two mask-bits per 16-bit lane
+		const __m128i ids = _mm_loadu_si128(reinterpret_cast<const __m128i*>(goalIDs));
+		const int mask = _mm_movemask_epi8(_mm_cmpeq_epi16(ids, startIDs));
+
+		for (int j = 0; j < n; j++) {
+			(*out)[i + j] = ((mask >> (j << 1)) & 1);
+			numPossible += (*out)[i + j];
+		}
+		#else
+		for (int j = 0; j < n; j++) {
+			(*out)[i + j] = (goalIDs[j] == startID);
+			numPossible += (*out)[i + j];
+		}
+		#endif
+	}
+
+	// all regions past the last ID share it, so goals in
+	// that region are only reachable if a search says so
+	if (startID == XAI_REGION_ID_MAX && numPossible > 0) {
+		std::vector<float3> sharedGoals;
+		std::vector<int> sharedGoalIdcs;
+		std::vector<float> sharedGoalLens;
+
+		for (int i = 0; i < numGoals; i++) {
+			if ((*out)[i] != 0) {
+				sharedGoals.push_back(goals[i]);
+				sharedGoalIdcs.push_back(i);
+			}
+		}
+
+		GetPathLengths(md->pathType, g->GetPos(), sharedGoals, 1e30f, &sharedGoalLens);
+
+		for (unsigned int k = 0; k < sharedGoalIdcs.size(); k++) {
+			if (sharedGoalLens[k] < 0.0f) {
+				(*out)[sharedGoalIdcs[k]] = 0;
+				numPossible -= 1;
+			}
+		}
+	}
+
+	return numPossible;
+}
+
+// labels the 4-connected regions of passable cells (two
+// cells that touch diagonally are only connected if a
+// unit can cut the corner, in which case they also share
+// a 4-connected neighbor)
+const std::vector<unsigned short>& XAICPathFinder::GetRegionIDs(int n) {
+	MaskEntry& e = maskEntries[n];
+
+	if (!e.regionIDs.empty()) {
+		return e.regionIDs;
+	}
+
+	const std::vector<unsigned int>& passBits = GetPassGrid(n);
+
+	XAICScopedTimer t("[XAICPathFinder::GetRegionIDs]", xaih->timer);
+
+	e.regionIDs.resize(xaiSlopeMap->GetArea(), 0);
+	e.freeRegionIDs.clear();
+	e.nextRegionID = 1;
+
+	for (int cell = 0; cell < xaiSlopeMap->GetArea(); cell++) {
+		if (e.regionIDs[cell] != 0 || ((passBits[cell >> 5] >> (cell & 31)) & 1) == 0) {
+			continue;
+		}
+
+		FloodRegion(e, cell, 0, NewRegionID(e));
+	}
+
+	return e.regionIDs;
+}
+
+// recycled IDs first; once they run out all new regions
+// get XAI_REGION_ID_MAX (and queries that see it in both
+// start and goal have to fall back to a search)
+unsigned short XAICPathFinder::NewRegionID(MaskEntry& e) const {
+	if (!e.freeRegionIDs.empty()) {
+		const unsigned short id = e.freeRegionIDs.back();
+		e.freeRegionIDs.pop_back();
+		return id;
+	}
+
+	if (e.nextRegionID == XAI_REGION_ID_MAX) {
+		LOG_BASIC(xaih->logger,
+			"[XAICPathFinder::NewRegionID] pathType " << e.moveData->pathType <<
+			" ran out of region-IDs, later regions share ID " << XAI_REGION_ID_MAX);
+	}
+
+	return (std::min(e.nextRegionID++, (unsigned int) XAI_REGION_ID_MAX));
+}
+
+// sets the 4-connected cells around <seed> whose ID is
+// <fromID> to <toID>; when labelling (toID != 0) only
+// passable cells are included
+void XAICPathFinder::FloodRegion(MaskEntry& e, int seed, unsigned short fromID, unsigned short toID) const {
+	const std::vector<unsigned int>& passBits = e.passBits;
+
+	const int smapx = xaiSlopeMap->GetSizeX();
+	const int smapy = xaiSlopeMap->GetSizeY();
+
+	#define INCLUDED(c) (e.regionIDs[(c)] == fromID && (toID == 0 || ((passBits[(c) >> 5] >> ((c) & 31)) & 1) != 0))
+
+	std::vector<int> cellStack;
+
+	e.regionIDs[seed] = toID;
+	cellStack.push_back(seed);
+
+	while (!cellStack.empty()) {
+		const int c = cellStack.back(); cellStack.pop_back();
+		const int x = c % smapx;
+		const int z = c / smapx;
+
+		const int nbrs[4] = {
+			(x > 0          )? (c - 1    ): -1,
+			(x < (smapx - 1))? (c + 1    ): -1,
+			(z > 0          )? (c - smapx): -1,
+			(z < (smapy - 1))? (c + smapx): -1,
+		};
+
+		for (int i = 0; i < 4; i++) {
+			const int nbr = nbrs[i];
+
+			if (nbr == -1 || !INCLUDED(nbr)) {
+				continue;
+			}
+
+			e.regionIDs[nbr] = toID;
+			cellStack.push_back(nbr);
+		}
+	}
+
+	#undef INCLUDED
+}
+
+// after the passability of the cells in <r> changed, only
+// the regions that touch <r> (or its one-cell border) can
+// have merged or split: those are erased and re-flooded,
+// all others keep their IDs
+void XAICPathFinder::RelabelRegions(int n, const XAIMapRect& r) {
+	XAICScopedTimer t("[XAICPathFinder::RelabelRegions]", xaih->timer);
+
+	MaskEntry& e = maskEntries[n];
+
+	const int smapx = xaiSlopeMap->GetSizeX();
+
+	XAIMapRect rr(r.xmin - 1, r.zmin - 1, r.xmax + 1, r.zmax + 1);
+	rr.ClipTo(smapx, xaiSlopeMap->GetSizeY());
+
+	for (int z = rr.zmin; z < rr.zmax; z++) {
+		for (int x = rr.xmin; x < rr.xmax; x++) {
+			const unsigned short id = e.regionIDs[z * smapx + x];
+
+			if (id == 0) {
+				continue;
+			}
+
+			FloodRegion(e, z * smapx + x, id, 0);
+
+			if (id != XAI_REGION_ID_MAX) {
+				e.freeRegionIDs.push_back(id);
+			}
+		}
+	}
+
+	// every cell connected to rr was part of an erased region
+	for (int z = rr.zmin; z < rr.zmax; z++) {
+		for (int x = rr.xmin; x < rr.xmax; x++) {
+			const int cell = z * smapx + x;
+
+			if (e.regionIDs[cell] != 0 || ((e.passBits[cell >> 5] >> (cell & 31)) & 1) == 0) {
+				continue;
+			}
+
+			FloodRegion(e, cell, 0, NewRegionID(e));
+		}
+	}
+}
+
+// compares XAI_TERRAIN_TILES_PER_FRAME tiles of our copy
+// of the height-map with the engine's (craters and other
+// deformations only change the latter), and takes over
+// the heights and slopes of any tiles that differ
+void XAICPathFinder::UpdateTerrain() {
+	if (maskJobs != NULL) {
+		// the pool is reading the maps, the tiles are
+		// diffed again once it is done
+		return;
+	}
+
+	XAICScopedTimer t("[XAICPathFinder::UpdateTerrain]", xaih->timer);
+
+	const int hmapx = xaiHeightMap->GetSizeX();
+	const int hmapy = xaiHeightMap->GetSizeY();
+	const int smapx = xaiSlopeMap->GetSizeX();
+	const int smapy = xaiSlopeMap->GetSizeY();
+
+	const int numTilesX = (hmapx + XAI_TERRAIN_TILE_SIZE - 1) / XAI_TERRAIN_TILE_SIZE;
+	const int numTilesZ = (hmapy + XAI_TERRAIN_TILE_SIZE - 1) / XAI_TERRAIN_TILE_SIZE;
+
+	const float* sprHeightMap = xaih->rcb->GetHeightMap();
+	      float* xaiHeights   = xaiHeightMap->GetData();
+
+	// bounds of the changed height-map pixels
+	XAIMapRect r(hmapx, hmapy, 0, 0);
+	bool changed = false;
+
+	for (int i = 0; i < XAI_TERRAIN_TILES_PER_FRAME && i < (numTilesX * numTilesZ); i++) {
+		const int tx = terrainTile % numTilesX;
+		const int tz = terrainTile / numTilesX;
+
+		terrainTile = (terrainTile + 1) % (numTilesX * numTilesZ);
+
+		const int x0 = tx * XAI_TERRAIN_TILE_SIZE, x1 = std::min(x0 + XAI_TERRAIN_TILE_SIZE, hmapx);
+		const int z0 = tz * XAI_TERRAIN_TILE_SIZE, z1 = std::min(z0 + XAI_TERRAIN_TILE_SIZE, hmapy);
+
+		for (int z = z0; z < z1; z++) {
+			const int idx = z * hmapx + x0;
+
+			if (std::memcmp(&sprHeightMap[idx], &xaiHeights[idx], (x1 - x0) * sizeof(float)) == 0) {
+				continue;
+			}
+
+			if (!changed) {
+				// TerrainChanged has to compare old and new
+				// passability, so every entry with masks needs
+				// a pass-grid of the terrain before the change
+				for (unsigned int n = 0; n < maskEntries.size(); n++) {
+					if (maskEntries[n].ready || maskEntries[n].queued) {
+						GetPassGrid(n);
+					}
+				}
+
+				changed = true;
+			}
+
+			std::memcpy(&xaiHeights[idx], &sprHeightMap[idx], (x1 - x0) * sizeof(float));
+
+			r.xmin = std::min(r.xmin, x0); r.xmax = std::max(r.xmax, x1);
+			r.zmin = std::min(r.zmin, z ); r.zmax = std::max(r.zmax, z + 1);
+		}
+	}
+
+	if (r.IsEmpty()) {
+		return;
+	}
+
+	// the slope of a cell also depends on the heights
+	// around it, so take one more cell on every side
+	XAIMapRect sr(HEIGHT2SLOPE(r.xmin) - 1, HEIGHT2SLOPE(r.zmin) - 1, HEIGHT2SLOPE(r.xmax - 1) + 2, HEIGHT2SLOPE(r.zmax - 1) + 2);
+	sr.ClipTo(smapx, smapy);
+
+	const float* sprSlopeMap = xaih->rcb->GetSlopeMap();
+	      float* xaiSlopes   = xaiSlopeMap->GetData();
+
+	for (int z = sr.zmin; z < sr.zmax; z++) {
+		std::memcpy(&xaiSlopes[z * smapx + sr.xmin], &sprSlopeMap[z * smapx + sr.xmin], (sr.xmax - sr.xmin) * sizeof(float));
+	}
+
+	TerrainChanged(sr);
+}
+
+void XAICPathFinder::TerrainChanged(const XAIMapRect& r) {
+	if (r.IsEmpty()) {
+		return;
+	}
+
+	const int smapx = xaiSlopeMap->GetSizeX();
+	const int hmapx = xaiHeightMap->GetSizeX();
+
+	// height-map columns under the rect's slope-map cells
+	const int hxmin = SLOPE2HEIGHT(r.xmin);
+	const int hxmax = SLOPE2HEIGHT(r.xmax - 1) + 1;
+
+	terrainChanged = true;
+	terrainSlopeBits.resize((xaiSlopeMap->GetArea() + 31) >> 5, 0);
+	terrainHeightBits.resize((xaiHeightMap->GetArea() + 31) >> 5, 0);
+
+	// engine path-lengths near the change are outdated
+	pathLengthCache->Invalidate(r);
+
+	for (unsigned int n = 0; n < maskEntries.size(); n++) {
+		MaskEntry& e = maskEntries[n];
+
+		if (e.passBits.empty()) {
+			// nothing derived from the terrain exists yet
+			// (see UpdateTerrain), later builds see the new one
+			continue;
+		}
+
+		bool passChanged = false;
+
+		for (int z = r.zmin; z < r.zmax; z++) {
+			// filter the words spanning this row of the rect
+			// (and the height-map row under it) in one go
+			const int s0 = z * smapx + r.xmin;
+			const int s1 = z * smapx + r.xmax;
+			const int h0 = SLOPE2HEIGHT(z) * hmapx + hxmin;
+			const int h1 = SLOPE2HEIGHT(z) * hmapx + hxmax;
+
+			e.maskFilter->GetPassBits(xaiSlopeMap, &terrainSlopeBits[0], s0 >> 5, ((s1 - 1) >> 5) + 1);
+			e.maskFilter->GetPassBits(xaiHeightMap, &terrainHeightBits[0], h0 >> 5, ((h1 - 1) >> 5) + 1);
+
+			for (int x = r.xmin; x < r.xmax; x++) {
+				const int sIdx = z * smapx + x;
+				const int hIdx = SLOPE2HEIGHT(z) * hmapx + SLOPE2HEIGHT(x);
+
+				const unsigned int oldBit = (e.passBits[sIdx >> 5] >> (sIdx & 31)) & 1;
+				const unsigned int newBit =
+					((terrainSlopeBits[sIdx >> 5] >> (sIdx & 31)) &
+					(terrainHeightBits[hIdx >> 5] >> (hIdx & 31)) & 1);
+
+				if (oldBit != newBit) {
+					e.passBits[sIdx >> 5] ^= (1U << (sIdx & 31));
+					passChanged = true;
+				}
+			}
+		}
+
+		if (!passChanged) {
+			continue;
+		}
+
+		if (!e.masksStale) {
+			e.masksStale = true;
+
+			// outdated masks are never read again, so stop
+			// making them and release what exists of them
+			if (e.queued) {
+				maskQueue.remove(n);
+				e.queued = false;
+			}
+
+			e.ready = false;
+			e.maskMap->FreeMasks();
+		}
+
+		if (e.pathGraph != NULL) {
+			e.pathGraph->MarkDirty(r);
+		}
+		if (!e.regionIDs.empty()) {
+			RelabelRegions(n, r);
+		}
+
+		// restart this entry's flow-fields from their goals
+		for (unsigned int i = 0; i < flowEntries.size(); i++) {
+			if (flowEntries[i].maskEntry == int(n)) {
+				flowEntries[i].field->Init(&e.passBits, flowEntries[i].field->GetGoalCell());
+			}
+		}
+	}
+}
+
+// region of the cell containing <pos>, or (for units on
+// impassable cells) that of any passable neighbor
+unsigned short XAICPathFinder::GetStartRegionID(const std::vector<unsigned short>& regionIDs, const float3& pos) const {
+	const int smapx = xaiSlopeMap->GetSizeX();
+	const int smapy = xaiSlopeMap->GetSizeY();
+
+	const int x = std::max(0, std::min(smapx - 1, WORLD2SLOPE(int(pos.x))));
+	const int z = std::max(0, std::min(smapy - 1, WORLD2SLOPE(int(pos.z))));
+
+	if (regionIDs[z * smapx + x] != 0) {
+		return regionIDs[z * smapx + x];
+	}
+
+	for (int nz = std::max(0, z - 1); nz <= std::min(smapy - 1, z + 1); nz++) {
+		for (int nx = std::max(0, x - 1); nx <= std::min(smapx - 1, x + 1); nx++) {
+			if (regionIDs[nz * smapx + nx] != 0) {
+				return regionIDs[nz * smapx + nx];
+			}
+		}
+	}
+
+	return 0;
+}
+
+
+// returns the slope-map cell of <pos> if it is passable,
+// otherwise the nearest passable one within a radius of
+// XAI_GOAL_SNAP_RADIUS cells (or -1 if there is none)
+int XAICPathFinder::GetGoalCell(const std::vector<unsigned int>& passBits, const float3& pos) const {
+	const int smapx = xaiSlopeMap->GetSizeX();
+	const int smapy = xaiSlopeMap->GetSizeY();
+
+	const int x = std::max(0, std::min(smapx - 1, WORLD2SLOPE(int(pos.x))));
+	const int z = std::max(0, std::min(smapy - 1, WORLD2SLOPE(int(pos.z))));
+
+	#define PASSABLE(n) (((passBits[(n) >> 5] >> ((n) & 31)) & 1) != 0)
+
+	if (PASSABLE(z * smapx + x)) {
+		return (z * smapx + x);
+	}
+
+	int bestCell = -1;
+	int bestDist = (XAI_GOAL_SNAP_RADIUS * XAI_GOAL_SNAP_RADIUS) + 1;
+
+	for (int nz = std::max(0, z - XAI_GOAL_SNAP_RADIUS); nz <= std::min(smapy - 1, z + XAI_GOAL_SNAP_RADIUS); nz++) {
+		for (int nx = std::max(0, x - XAI_GOAL_SNAP_RADIUS); nx <= std::min(smapx - 1, x + XAI_GOAL_SNAP_RADIUS); nx++) {
+			const int dist = (nx - x) * (nx - x) + (nz - z) * (nz - z);
+
+			if (dist < bestDist && PASSABLE(nz * smapx + nx)) {
+				bestDist = dist;
+				bestCell = nz * smapx + nx;
+			}
+		}
+	}
+
+	#undef PASSABLE
+
+	return bestCell;
+}
+
+
+
+// returns the slope-map cells passable for entry <n>,
+// a cell being passable if both it and the height-map
+// pixel at its top-left corner pass the entry's filter
+const std::vector<unsigned int>& XAICPathFinder::GetPassGrid(int n) {
+	MaskEntry& e = maskEntries[n];
+
+	if (!e.passBits.empty()) {
+		return e.passBits;
+	}
+
+	XAICScopedTimer t("[XAICPathFinder::GetPassGrid]", xaih->timer);
+
+	const int smapx = xaiSlopeMap->GetSizeX();
+	const int smapy = xaiSlopeMap->GetSizeY();
+	const int hmapx = xaiHeightMap->GetSizeX();
+
+	std::vector<unsigned int> heightBits((xaiHeightMap->GetArea() + 31) >> 5, 0);
+
+	e.passBits.resize((xaiSlopeMap->GetArea() + 31) >> 5, 0);
+	e.maskFilter->GetPassBits(xaiSlopeMap, &e.passBits[0], 0, e.passBits.size());
+	e.maskFilter->GetPassBits(xaiHeightMap, &heightBits[0], 0, heightBits.size());
+
+	for (int z = 0; z < smapy; z++) {
+		for (int x = 0; x < smapx; x++) {
+			const int sIdx = z * smapx + x;
+			const int hIdx = SLOPE2HEIGHT(z) * hmapx + SLOPE2HEIGHT(x);
+
+			if (((heightBits[hIdx >> 5] >> (hIdx & 31)) & 1) == 0) {
+				e.passBits[sIdx >> 5] &= ~(1U << (sIdx & 31));
+			}
+		}
+	}
+
+	return e.passBits;
+}
+
+
+
+// the open-list is a 4-ary min-heap on f = g + h; nodes
+// whose cost improves are pushed again, and the stale
+// entries are skipped when popped (node is closed then)
+void XAICPathFinder::PushOpenNode(int node, float f) {
+	int i = openHeap.size();
+
+	openHeap.push_back(OpenNode(node, f));
+
+	while (i > 0) {
+		const int p = (i - 1) >> 2;
+
+		if (openHeap[p].f <= f) {
+			break;
+		}
+
+		openHeap[i] = openHeap[p]; i = p;
+	}
+
+	openHeap[i] = OpenNode(node, f);
+}
+
+int XAICPathFinder::PopOpenNode() {
+	const int node = openHeap[0].node;
+	const OpenNode last = openHeap.back();
+
+	openHeap.pop_back();
+
+	const int size = openHeap.size();
+
+	if (size == 0) {
+		return node;
+	}
+
+	int i = 0;
+
+	while (true) {
+		const int c0 = (i << 2) + 1;
+
+		if (c0 >= size) {
+			break;
+		}
+
+		int c = c0;
+
+		for (int k = c0 + 1; k < std::min(c0 + 4, size); k++) {
+			if (openHeap[k].f < openHeap[c].f) {
+				c = k;
+			}
+		}
+
+		if (openHeap[c].f >= last.f) {
+			break;
+		}
+
+		openHeap[i] = openHeap[c]; i = c;
+	}
+
+	openHeap[i] = last;
+	return node;
+}
+
+// returns the flow-field of entry <n> toward <goalCell>;
+// a new goal replaces the least recently used field that
+// is complete and was not used this frame, if there is no
+// such field the goal is refused (NULL) so that fields in
+// use are never thrown away before they could answer
+XAICFlowField* XAICPathFinder::RequestFlowField(int n, int goalCell) {
+	const unsigned int frame = xaih->GetCurrFrame();
+
+	int lru = -1;
+
+	for (unsigned int i = 0; i < flowEntries.size(); i++) {
+		FlowEntry& e = flowEntries[i];
+
+		if (e.maskEntry == n && e.field->GetGoalCell() == goalCell) {
+			e.lastUse = ++flowUseCounter;
+			e.useFrame = frame;
+			return e.field;
+		}
+
+		if (!e.field->IsDone() || e.useFrame == frame) {
+			continue;
+		}
+		if (lru == -1 || e.lastUse < flowEntries[lru].lastUse) {
+			lru = i;
+		}
+	}
+
+	if (flowEntries.size() < XAI_FLOWFIELD_CACHE_SIZE) {
+		lru = flowEntries.size();
+		flowEntries.push_back(FlowEntry(new XAICFlowField(xaiSlopeMap->GetSizeX(), xaiSlopeMap->GetSizeY())));
+	}
+
+	if (lru == -1) {
+		return NULL;
+	}
+
+	FlowEntry& e = flowEntries[lru];
+
+	e.maskEntry = n;
+	e.lastUse = ++flowUseCounter;
+	e.useFrame = frame;
+	e.field->Init(&GetPassGrid(n), goalCell);
+
+	return e.field;
+}
+
+// finds the cell of a position in a flow-field; units on
+// impassable cells (never reached by the field) use their
+// cheapest settled neighbor instead
+XAIPathQueryResult XAICPathFinder::GetFlowCell(int n, const XAICFlowField* field, const float3& pos, int* cell) const {
+	const std::vector<unsigned int>& passBits = maskEntries[n].passBits;
+
+	const int smapx = xaiSlopeMap->GetSizeX();
+	const int smapy = xaiSlopeMap->GetSizeY();
+
+	const int x = std::max(0, std::min(smapx - 1, WORLD2SLOPE(int(pos.x))));
+	const int z = std::max(0, std::min(smapy - 1, WORLD2SLOPE(int(pos.z))));
+
+	*cell = z * smapx + x;
+
+	if (field->IsSettled(*cell)) {
+		return XAI_PATH_POSSIBLE;
+	}
+
+	if (((passBits[*cell >> 5] >> (*cell & 31)) & 1) == 0) {
+		int bestCell = -1;
+
+		for (int nz = std::max(0, z - 1); nz <= std::min(smapy - 1, z + 1); nz++) {
+			for (int nx = std::max(0, x - 1); nx <= std::min(smapx - 1, x + 1); nx++) {
+				const int nbr = nz * smapx + nx;
+
+				if (!field->IsSettled(nbr)) {
+					continue;
+				}
+				if (bestCell == -1 || field->GetCost(nbr) < field->GetCost(bestCell)) {
+					bestCell = nbr;
+				}
+			}
+		}
+
+		if (bestCell != -1) {
+			*cell = bestCell;
+			return XAI_PATH_POSSIBLE;
+		}
+	}
+
+	return (field->IsDone()? XAI_PATH_IMPOSSIBLE: XAI_PATH_PENDING);
+}
+
+XAIPathQueryResult XAICPathFinder::GetFlowPathLength(int pathType, const float3& pos, const float3& goal, float* len) {
+	std::map<int, int>::const_iterator it = maskEntryIDs.find(pathType);
+
+	if (it == maskEntryIDs.end()) {
+		return XAI_PATH_IMPOSSIBLE;
+	}
+
+	const int goalCell = GetGoalCell(GetPassGrid(it->second), goal);
+
+	if (goalCell == -1) {
+		return XAI_PATH_IMPOSSIBLE;
+	}
+
+	const XAICFlowField* field = RequestFlowField(it->second, goalCell);
+
+	if (field == NULL) {
+		return XAI_PATH_PENDING;
+	}
+
+	int cell = -1;
+
+	const XAIPathQueryResult ret = GetFlowCell(it->second, field, pos, &cell);
+
+	if (ret == XAI_PATH_POSSIBLE) {
+		*len = field->GetCost(cell) * SLOPE2WORLD(1);
+	}
+
+	return ret;
+}
+
+XAIPathQueryResult XAICPathFinder::GetFlowWaypoint(int pathType, const float3& pos, const float3& goal, float3* wp) {
+	std::map<int, int>::const_iterator it = maskEntryIDs.find(pathType);
+
+	if (it == maskEntryIDs.end()) {
+		return XAI_PATH_IMPOSSIBLE;
+	}
+
+	const int goalCell = GetGoalCell(GetPassGrid(it->second), goal);
+
+	if (goalCell == -1) {
+		return XAI_PATH_IMPOSSIBLE;
+	}
+
+	const XAICFlowField* field = RequestFlowField(it->second, goalCell);
+
+	if (field == NULL) {
+		return XAI_PATH_PENDING;
+	}
+
+	int cell = -1;
+
+	const XAIPathQueryResult ret = GetFlowCell(it->second, field, pos, &cell);
+
+	if (ret == XAI_PATH_POSSIBLE) {
+		// every cell on the way is settled already
+		for (int i = 0; i < XAI_FLOWFIELD_WAYPOINT_STEPS; i++) {
+			const int next = field->GetNextCell(cell);
+
+			if (next == -1) {
+				break;
+			}
+
+			cell = next;
+		}
+
+		*wp = GetCellPos(cell);
+	}
+
+	return ret;
+}
+
+// extends the unfinished flow-fields by a total of at most
+// XAI_FLOWFIELD_FRAME_CELLS cells, most recently used first
+void XAICPathFinder::UpdateFlowFields() {
+	int numCells = XAI_FLOWFIELD_FRAME_CELLS;
+
+	while (numCells > 0) {
+		int next = -1;
+
+		for (unsigned int i = 0; i < flowEntries.size(); i++) {
+			if (flowEntries[i].field->IsDone()) {
+				continue;
+			}
+			if (next == -1 || flowEntries[i].lastUse > flowEntries[next].lastUse) {
+				next = i;
+			}
+		}
+
+		if (next == -1) {
+			break;
+		}
+
+		XAICScopedTimer t("[XAICPathFinder::UpdateFlowFields]", xaih->timer);
+		numCells -= flowEntries[next].field->Step(numCells);
+	}
+}
+
+
+
+float XAICPathFinder::GetPathLength(const float3& wStart, const float3& wGoal, int pathType) {
+	const int smapx = xaiSlopeMap->GetSizeX();
+	const int smapy = xaiSlopeMap->GetSizeY();
+
+	const int xS = std::max(0, std::min(smapx - 1, WORLD2SLOPE(int(wStart.x))));
+	const int zS = std::max(0, std::min(smapy - 1, WORLD2SLOPE(int(wStart.z))));
+	const int xG = std::max(0, std::min(smapx - 1, WORLD2SLOPE(int(wGoal.x))));
+	const int zG = std::max(0, std::min(smapy - 1, WORLD2SLOPE(int(wGoal.z))));
+
+	float len = 0.0f;
+
+	if (pathLengthCache->Get(pathType, zS * smapx + xS, zG * smapx + xG, xaih->GetCurrFrame(), &len)) {
+		return len;
+	}
+
+	XAICScopedTimer t("[XAICPathFinder::GetPathLength]", xaih->timer);
+
+	len = xaih->rcb->GetPathLength(wStart, wGoal, pathType);
+	pathLengthCache->Put(pathType, zS * smapx + xS, zG * smapx + xG, xaih->GetCurrFrame(), len);
+	return len;
+}
+
+void XAICPathFinder::SetPathLengthTTL(unsigned int frames) {
+	pathLengthCache->SetTTL(frames);
+}
+
+void XAICPathFinder::InvalidatePathLengths(const XAIMapRect& r) {
+	pathLengthCache->Invalidate(r);
+}
+
+
+
+bool XAICPathFinder::GetPathLengths(int pathType, const float3& wStart, const std::vector<float3>& wGoals, float maxLen, std::vector<float>* lens) {
+	std::map<int, int>::const_iterator it = maskEntryIDs.find(pathType);
+
+	if (it == maskEntryIDs.end()) {
+		return false;
+	}
+
+	XAICScopedTimer t("[XAICPathFinder::GetPathLengths]", xaih->timer);
+
+	const std::vector<unsigned int>& passBits = GetPassGrid(it->second);
+
+	const int smapx = xaiSlopeMap->GetSizeX();
+	const int smapy = xaiSlopeMap->GetSizeY();
+
+	const int xS = std::max(0, std::min(smapx - 1, WORLD2SLOPE(int(wStart.x))));
+	const int zS = std::max(0, std::min(smapy - 1, WORLD2SLOPE(int(wStart.z))));
+	const int startNode = zS * smapx + xS;
+
+	const float cellSize = SLOPE2WORLD(1);
+	const float maxCost = maxLen / cellSize;
+
+	#define PASSABLE(n) (((passBits[(n) >> 5] >> ((n) & 31)) & 1) != 0)
+
+	if ((searchGen += 1) == 0) {
+		std::fill(nodeGens.begin(), nodeGens.end(), 0);
+		searchGen = 1;
+	}
+
+	// goal-cells are flagged up-front (several goals may
+	// share one) so settling a node needs no lookup unless
+	// it is flagged; unflagged cells are seen as stale
+	std::vector<int> goalNodes(wGoals.size(), -1);
+	int numGoals = 0;
+
+	lens->clear();
+	lens->resize(wGoals.size(), -1.0f);
+
+	for (unsigned int i = 0; i < wGoals.size(); i++) {
+		const int xG = std::max(0, std::min(smapx - 1, WORLD2SLOPE(int(wGoals[i].x))));
+		const int zG = std::max(0, std::min(smapy - 1, WORLD2SLOPE(int(wGoals[i].z))));
+		// the start-cell is settled first even if impassable
+		const int goalNode = ((zG * smapx + xG) == startNode)? startNode: GetGoalCell(passBits, wGoals[i]);
+
+		if (goalNode == -1) {
+			continue;
+		}
+
+		goalNodes[i] = goalNode;
+
+		if (nodeGens[goalNode] != searchGen) {
+			nodeGens[goalNode]   = searchGen;
+			nodeStates[goalNode] = XAI_NODE_STATE_GOAL;
+			nodeCosts[goalNode]  = 1e30f;
+			numGoals += 1;
+		}
+	}
+
+	static const int   dirX[8] = {1, -1,  0,  0,  1, -1,  1, -1};
+	static const int   dirZ[8] = {0,  0,  1, -1,  1,  1, -1, -1};
+	static const float dirC[8] = {1.0f, 1.0f, 1.0f, 1.0f, M_SQRT2, M_SQRT2, M_SQRT2, M_SQRT2};
+
+	openHeap.clear();
+
+	if (nodeGens[startNode] != searchGen) {
+		nodeGens[startNode]   = searchGen;
+		nodeStates[startNode] = 0;
+	}
+
+	nodeStates[startNode] |= XAI_NODE_STATE_OPEN;
+	nodeCosts[startNode]   = 0.0f;
+	nodeParents[startNode] = -1;
+
+	PushOpenNode(startNode, 0.0f);
+
+	while (!openHeap.empty() && numGoals > 0) {
+		const int node = PopOpenNode();
+
+		if ((nodeStates[node] & XAI_NODE_STATE_CLOSED) != 0) {
+			continue;
+		}
+		if (nodeCosts[node] > maxCost) {
+			break;
+		}
+
+		nodeStates[node] |= XAI_NODE_STATE_CLOSED;
+		numGoals -= int((nodeStates[node] & XAI_NODE_STATE_GOAL) != 0);
+
+		const int x = node % smapx;
+		const int z = node / smapx;
+
+		for (int d = 0; d < 8; d++) {
+			const int nx = x + dirX[d];
+			const int nz = z + dirZ[d];
+
+			if (nx < 0 || nx >= smapx) { continue; }
+			if (nz < 0 || nz >= smapy) { continue; }
+
+			const int nbr = nz * smapx + nx;
+
+			if (!PASSABLE(nbr)) {
+				continue;
+			}
+			if (d >= 4 && (!PASSABLE(z * smapx + nx) || !PASSABLE(nz * smapx + x))) {
+				continue;
+			}
+
+			const float g = nodeCosts[node] + dirC[d];
+
+			if (nodeGens[nbr] == searchGen) {
+				if ((nodeStates[nbr] & XAI_NODE_STATE_CLOSED) != 0) { continue; }
+				if ((nodeStates[nbr] & XAI_NODE_STATE_OPEN) != 0 && nodeCosts[nbr] <= g) { continue; }
+			} else {
+				nodeGens[nbr]   = searchGen;
+				nodeStates[nbr] = 0;
+			}
+
+			nodeStates[nbr] |= XAI_NODE_STATE_OPEN;
+			nodeCosts[nbr]   = g;
+			nodeParents[nbr] = node;
+
+			PushOpenNode(nbr, g);
+		}
+	}
+
+	#undef PASSABLE
+
+	for (unsigned int i = 0; i < goalNodes.size(); i++) {
+		const int goalNode = goalNodes[i];
+
+		if (goalNode == -1) {
+			continue;
+		}
+		if ((nodeStates[goalNode] & XAI_NODE_STATE_CLOSED) == 0) {
+			continue;
+		}
+
+		(*lens)[i] = nodeCosts[goalNode] * cellSize;
+	}
+
+	return true;
+}
+
+int XAICPathFinder::CompressPath(int pathType, const std::vector<float3>& path, std::vector<short>* cells) {
+	cells->clear();
+
+	std::map<int, int>::const_iterator it = maskEntryIDs.find(pathType);
+
+	if (it == maskEntryIDs.end() || path.empty()) {
+		return 0;
+	}
+
+	XAICScopedTimer t("[XAICPathFinder::CompressPath]", xaih->timer);
+
+	const std::vector<unsigned int>& passBits = GetPassGrid(it->second);
+
+	const int smapx = xaiSlopeMap->GetSizeX();
+	const int smapy = xaiSlopeMap->GetSizeY();
+
+	// waypoints in slope-map cells
+	std::vector<int> xs(path.size());
+	std::vector<int> zs(path.size());
+
+	for (unsigned int i = 0; i < path.size(); i++) {
+		xs[i] = std::max(0, std::min(smapx - 1, WORLD2SLOPE(int(path[i].x))));
+		zs[i] = std::max(0, std::min(smapy - 1, WORLD2SLOPE(int(path[i].z))));
+	}
+
+	unsigned int anchor = 0;
+
+	cells->push_back(xs[anchor]);
+	cells->push_back(zs[anchor]);
+
+	while (anchor < (path.size() - 1)) {
+		// extend the segment from the anchor for as long as
+		// the straight line to the next waypoint is walkable
+		unsigned int next = anchor + 1;
+
+		while ((next + 1) < path.size() && IsLineWalkable(passBits, xs[anchor], zs[anchor], xs[next + 1], zs[next + 1])) {
+			next += 1;
+		}
+
+		cells->push_back(xs[next]);
+		cells->push_back(zs[next]);
+
+		anchor = next;
+	}
+
+	return (cells->size() >> 1);
+}
+
+void XAICPathFinder::DecodePath(const std::vector<short>& cells, std::vector<float3>* path) const {
+	path->clear();
+	path->reserve(cells.size() >> 1);
+
+	for (unsigned int i = 0; (i + 1) < cells.size(); i += 2) {
+		path->push_back(GetCellPos(cells[i + 1] * xaiSlopeMap->GetSizeX() + cells[i]));
+	}
+}
+
+// Bresenham line over the slope-map cells from (x0, z0) to
+// (x1, z1); every cell after the first must be passable, and
+// a diagonal step also needs both cells beside it passable
+// (same rule as the searches, so no corners are cut)
+bool XAICPathFinder::IsLineWalkable(const std::vector<unsigned int>& passBits, int x0, int z0, int x1, int z1) const {
+	const int smapx = xaiSlopeMap->GetSizeX();
+
+	#define PASSABLE(x, z) (((passBits[((z) * smapx + (x)) >> 5] >> (((z) * smapx + (x)) & 31)) & 1) != 0)
+
+	const int dx =  std::abs(x1 - x0), sx = (x0 < x1)? 1: -1;
+	const int dz = -std::abs(z1 - z0), sz = (z0 < z1)? 1: -1;
+
+	int err = dx + dz;
+	int x = x0;
+	int z = z0;
+
+	while (x != x1 || z != z1) {
+		const int e2 = err << 1;
+		const bool stepX = (e2 >= dz);
+		const bool stepZ = (e2 <= dx);
+
+		if (stepX && stepZ && (!PASSABLE(x + sx, z) || !PASSABLE(x, z + sz))) {
+			return false;
+		}
+
+		if (stepX) { err += dz; x += sx; }
+		if (stepZ) { err += dx; z += sz; }
+
+		if (!PASSABLE(x, z)) {
+			return false;
+		}
+	}
+
+	#undef PASSABLE
+
+	return true;
+}
+
+
+
+// returns the abstract graph of entry <n>, building it
+// (and the entry's pass-grid) if this is the first use
+XAICPathGraph* XAICPathFinder::GetPathGraph(int n) {
+	MaskEntry& e = maskEntries[n];
+
+	if (e.pathGraph != NULL) {
+		return e.pathGraph;
+	}
+
+	const std::vector<unsigned int>& passBits = GetPassGrid(n);
+
+	{
+		XAICScopedTimer t("[XAICPathFinder::GetPathGraph]", xaih->timer);
+
+		e.pathGraph = new XAICPathGraph(&passBits, xaiSlopeMap->GetSizeX(), xaiSlopeMap->GetSizeY(), XAI_PATHGRAPH_CLUSTER_SIZE);
+		e.pathGraph->Update();
+	}
+
+	return e.pathGraph;
+}
+
+float XAICPathFinder::FindPath(int pathType, const float3& wStart, const float3& wGoal, std::vector<float3>* path, float threatCost, float heuristicWeight) {
+	XAICScopedTimer t("[XAICPathFinder::FindPath]", xaih->timer);
+
+	std::map<int, int>::const_iterator it = maskEntryIDs.find(pathType);
+
+	if (it == maskEntryIDs.end()) {
+		return -1.0f;
+	}
+
+	const std::vector<unsigned int>& passBits = GetPassGrid(it->second);
+
+	const int smapx = xaiSlopeMap->GetSizeX();
+	const int smapy = xaiSlopeMap->GetSizeY();
+
+	const int xS = std::max(0, std::min(smapx - 1, WORLD2SLOPE(int(wStart.x))));
+	const int zS = std::max(0, std::min(smapy - 1, WORLD2SLOPE(int(wStart.z))));
+	const int xG = std::max(0, std::min(smapx - 1, WORLD2SLOPE(int(wGoal.x))));
+	const int zG = std::max(0, std::min(smapy - 1, WORLD2SLOPE(int(wGoal.z))));
+
+	const int startNode = zS * smapx + xS;
+	const int goalNode  = zG * smapx + xG;
+
+	// costs are in slope-map cells, converted at the end
+	const float cellSize = SLOPE2WORLD(1);
+
+	#if (XAI_PATHGRAPH == 1)
+	if (threatCost <= 0.0f && GetOctileDist(xS, zS, xG, zG) > XAI_PATHGRAPH_MIN_DIST) {
+		std::vector<int> cells;
+
+		const float cost = GetPathGraph(it->second)->FindPath(startNode, goalNode, &cells);
+
+		if (cost < 0.0f) {
+			return -1.0f;
+		}
+
+		if (path != NULL) {
+			path->clear();
+
+			// the first leg should stay within the start's
+			// cluster, but the graph may be out of date with
+			// the terrain (eg. a dirty cluster not rebuilt
+			// yet), so fall back to a flat search if it fails
+			if (SearchGrid(passBits, startNode, cells[1], 0.0f, 1.0f) < 0.0f) {
+				const float flatCost = SearchGrid(passBits, startNode, goalNode, 0.0f, 1.0f);
+
+				if (flatCost < 0.0f) {
+					return -1.0f;
+				}
+
+				AddGridPath(goalNode, path);
+				return (flatCost * cellSize);
+			}
+
+			AddGridPath(cells[1], path);
+
+			for (unsigned int i = 2; i < cells.size(); i++) {
+				path->push_back(GetCellPos(cells[i]));
+			}
+		}
+
+		return (cost * cellSize);
+	}
+	#endif
+
+	const float cost = SearchGrid(passBits, startNode, goalNode, threatCost, std::max(heuristicWeight, 1.0f));
+
+	if (cost < 0.0f) {
+		return -1.0f;
+	}
+
+	if (path != NULL) {
+		path->clear();
+		AddGridPath(goalNode, path);
+	}
+
+	return (cost * cellSize);
+}
+
+// A* between two slope-map cells, returns the cost (in
+// cells) or -1; the path is left behind in nodeParents
+//
+// all step costs are at least their length in cells, so
+// the octile distance stays admissible with threat costs
+// (unless it is scaled by a <heuristicWeight> above 1)
+float XAICPathFinder::SearchGrid(const std::vector<unsigned int>& passBits, int startNode, int goalNode, float threatCost, float heuristicWeight) {
+	const int smapx = xaiSlopeMap->GetSizeX();
+	const int smapy = xaiSlopeMap->GetSizeY();
+
+	const int xG = goalNode % smapx;
+	const int zG = goalNode / smapx;
+
+	#define PASSABLE(n) (((passBits[(n) >> 5] >> ((n) & 31)) & 1) != 0)
+
+	// units can stand on impassable terrain (and
+	// should be able to leave it), but not end up
+	// on it
+	if (!PASSABLE(goalNode)) {
+		return -1.0f;
+	}
+
+	// starting a new search invalidates all node-state
+	// of the previous one at once (apart from wrapping)
+	if ((searchGen += 1) == 0) {
+		std::fill(nodeGens.begin(), nodeGens.end(), 0);
+		searchGen = 1;
+	}
+
+	static const int   dirX[8] = {1, -1,  0,  0,  1, -1,  1, -1};
+	static const int   dirZ[8] = {0,  0,  1, -1,  1,  1, -1, -1};
+	static const float dirC[8] = {1.0f, 1.0f, 1.0f, 1.0f, M_SQRT2, M_SQRT2, M_SQRT2, M_SQRT2};
+
+	openHeap.clear();
+
+	nodeGens[startNode]    = searchGen;
+	nodeStates[startNode]  = XAI_NODE_STATE_OPEN;
+	nodeCosts[startNode]   = 0.0f;
+	nodeParents[startNode] = -1;
+
+	PushOpenNode(startNode, GetOctileDist(startNode % smapx, startNode / smapx, xG, zG) * heuristicWeight);
+
+	bool found = false;
+
+	while (!openHeap.empty()) {
+		const int node = PopOpenNode();
+
+		if (nodeStates[node] == XAI_NODE_STATE_CLOSED) {
+			continue;
+		}
+		if (node == goalNode) {
+			found = true; break;
+		}
+
+		nodeStates[node] = XAI_NODE_STATE_CLOSED;
+
+		const int x = node % smapx;
+		const int z = node / smapx;
+
+		for (int d = 0; d < 8; d++) {
+			const int nx = x + dirX[d];
+			const int nz = z + dirZ[d];
+
+			if (nx < 0 || nx >= smapx) { continue; }
+			if (nz < 0 || nz >= smapy) { continue; }
+
+			const int nbr = nz * smapx + nx;
+
+			if (!PASSABLE(nbr)) {
+				continue;
+			}
+
+			// no cutting corners on diagonal moves
+			if (d >= 4 && (!PASSABLE(z * smapx + nx) || !PASSABLE(nz * smapx + x))) {
+				continue;
+			}
+
+			// the threat is only sampled for cells that are
+			// actually reached by the search
+			const float w = (threatCost > 0.0f)? (1.0f + threatCost * GetCellThreat(nbr)): 1.0f;
+			const float g = nodeCosts[node] + dirC[d] * w;
+
+			if (nodeGens[nbr] == searchGen) {
+				if (nodeStates[nbr] == XAI_NODE_STATE_CLOSED) { continue; }
+				if (nodeCosts[nbr] <= g) { continue; }
+			}
+
+			nodeGens[nbr]    = searchGen;
+			nodeStates[nbr]  = XAI_NODE_STATE_OPEN;
+			nodeCosts[nbr]   = g;
+			nodeParents[nbr] = node;
+
+			PushOpenNode(nbr, g + GetOctileDist(nx, nz, xG, zG) * heuristicWeight);
+		}
+	}
+
+	#undef PASSABLE
+
+	return (found? nodeCosts[goalNode]: -1.0f);
+}
+
+float XAICPathFinder::GetCellThreat(int cell) {
+	const float3 pos = GetCellPos(cell);
+	const unsigned int version = xaih->threatMap->GetVersion(pos);
+
+	if (cellThreatVers[cell] != version) {
+		cellThreatVers[cell] = version;
+		cellThreats[cell] = xaih->threatMap->GetThreat(pos);
+	}
+
+	return cellThreats[cell];
+}
+
+// appends the waypoints of the last SearchGrid to <path>
+void XAICPathFinder::AddGridPath(int goalNode, std::vector<float3>* path) const {
+	const unsigned int first = path->size();
+
+	for (int node = goalNode; node != -1; node = nodeParents[node]) {
+		path->push_back(GetCellPos(node));
+	}
+
+	std::reverse(path->begin() + first, path->end());
+}
+
+// world-space center of a slope-map cell, on the ground
+float3 XAICPathFinder::GetCellPos(int cell) const {
+	const int x = cell % xaiSlopeMap->GetSizeX();
+	const int z = cell / xaiSlopeMap->GetSizeX();
+	const float y = xaiHeightMap->GetValue(SLOPE2HEIGHT(x), SLOPE2HEIGHT(z));
+	const float cellSize = SLOPE2WORLD(1);
+
+	return (float3(SLOPE2WORLD(x) + cellSize * 0.5f, y, SLOPE2WORLD(z) + cellSize * 0.5f));
+}
+
+// admissible (and consistent) for 8-connected grids
+float XAICPathFinder::GetOctileDist(int x0, int z0, int x1, int z1) {
+	const int dx = std::abs(x1 - x0);
+	const int dz = std::abs(z1 - z0);
+
+	return (std::max(dx, dz) + (M_SQRT2 - 1.0f) * std::min(dx, dz));
+}
+
+
+
+// runs flat and hierarchical searches between random
+// far-apart cells of entry <n> and returns (and logs) the
+// number of queries on which they disagree: either about
+// whether a path exists, or with a graph path shorter than
+// the optimal flat one (which it can never be)
+int XAICPathFinder::CheckPathGraph(int n) {
+	const std::vector<unsigned int>& passBits = GetPassGrid(n);
+	XAICPathGraph* pathGraph = maskEntries[n].pathGraph;
+
+	const int smapx = xaiSlopeMap->GetSizeX();
+	const int smapy = xaiSlopeMap->GetSizeY();
+
+	float sumFlat = 0.0f;
+	float sumHier = 0.0f;
+	int numPaths = 0;
+	int numDiffs = 0;
+
+	for (int i = 0; i < XAI_PATHGRAPH_SELFCHECK_QUERIES; i++) {
+		const int xS = (*xaih->irng)() % smapx, zS = (*xaih->irng)() % smapy;
+		const int xG = (*xaih->irng)() % smapx, zG = (*xaih->irng)() % smapy;
+
+		if (GetOctileDist(xS, zS, xG, zG) <= XAI_PATHGRAPH_MIN_DIST) {
+			continue;
+		}
+
+		const float costFlat = SearchGrid(passBits, zS * smapx + xS, zG * smapx + xG, 0.0f, 1.0f);
+		const float costHier = pathGraph->FindPath(zS * smapx + xS, zG * smapx + xG, NULL);
+
+		if ((costFlat < 0.0f) != (costHier < 0.0f)) {
+			numDiffs += 1; continue;
+		}
+		if (costFlat < 0.0f) {
+			continue;
+		}
+		if (costHier < (costFlat * 0.999f)) {
+			numDiffs += 1; continue;
+		}
+
+		sumFlat += costFlat;
+		sumHier += costHier;
+		numPaths += 1;
+	}
+
+	LOG_BASIC(xaih->logger,
+		"[XAICPathFinder::CheckPathGraph] pathType " << maskEntries[n].moveData->pathType <<
+		", " << pathGraph->GetNumNodes() << " nodes, " << numPaths << " paths, " <<
+		numDiffs << " mismatches, length ratio (hier / flat): " << ((numPaths > 0)? (sumHier / sumFlat): 0.0f));
+
+	return numDiffs;
 }
@@ -1,32 +1,283 @@
 #ifndef XAI_PATHFINDER_HDR
 #define XAI_PATHFINDER_HDR
 
+#include <algorithm>
+#include <list>
 #include <map>
+#include <string>
 #include <vector>
 
+#include "../events/XAIIEventReceiver.hpp"
+
 class float3;
+class XAICFlowField;
+class XAICPathGraph;
+class XAICPathLengthCache;
 struct MoveData;
+struct XAIIEvent;
 struct XAIHelper;
-struct XAIIPathNode;
+struct XAIMoveDataKey;
 struct XAIGroup;
+struct XAIMapRect;
 template<typename T> struct XAIMap;
 template<typename T> struct XAIMaskMap;
+template<typename T> struct XAIIMapPixelFilter;
+
+enum XAIPathQueryResult {
+	XAI_PATH_IMPOSSIBLE = 0,
+	XAI_PATH_POSSIBLE   = 1,
+	XAI_PATH_PENDING    = 2, // masks for the pathType not generated yet
+};
 
-class XAICPathFinder {
+class XAICPathFinder: public XAIIEventReceiver {
 public:
 	XAICPathFinder(XAIHelper*);
 	~XAICPathFinder();
 
-	bool IsPathPossible(const XAIGroup*, const float3&, const float3&) const;
+	void OnEvent(const XAIIEvent*);
+
+	// the first query for a pathType queues its masks to be
+	// loaded or made over the next frames (see UpdateMasks)
+	// and until then all queries for it are pending
+	XAIPathQueryResult IsPathPossible(const XAIGroup*, const float3&, const float3&);
+	// reachability of many goals from a group's position at
+	// once, from the connected regions of the slope-map for
+	// the group's pathType (which unlike the masks are always
+	// available); sets out[i] to whether goals[i] can be
+	// reached (1) or not (0) and returns how many can
+	int IsPathPossibleBatch(const XAIGroup*, const std::vector<float3>& goals, std::vector<unsigned char>* out);
+
+	// A* over the slope-map for units of <pathType>; returns
+	// the length in elmos of the shortest path and (if <path>
+	// is non-NULL) fills it with the world-space waypoints
+	// from start to goal (one per cell), or -1 if there is
+	// no path
+	//
+	// long queries are answered by the abstract graph, whose
+	// paths are slightly longer; only their first leg (up to
+	// the start's cluster exit) is refined into cells, later
+	// legs are single waypoints that need their own query
+	// once reached
+	//
+	// if <threatCost> is positive, entering a cell costs
+	// (1 + threatCost * threat) times as much, where the
+	// threat is sampled from the threat-map when needed;
+	// such searches never use the abstract graph (whose
+	// distances do not include threat)
+	//
+	// <heuristicWeight> scales the A* heuristic: 1 keeps the
+	// search optimal, any w > 1 makes it return a path at
+	// most w times as costly as the best one but makes it
+	// expand far fewer cells
+	float FindPath(int pathType, const float3&, const float3&, std::vector<float3>* path, float threatCost = 0.0f, float heuristicWeight = 1.0f);
+
+	// Dijkstra from <start> over the slope-map of <pathType>
+	// that stops once every goal is settled or all cells
+	// within <maxLen> elmos are, and stores the path-length
+	// to each goal (or -1 if unreachable or farther than
+	// <maxLen>) in <lens>; a goal on an impassable cell is
+	// measured to the nearest passable cell around it, and
+	// returns false if the pathType is unknown
+	bool GetPathLengths(int pathType, const float3& start, const std::vector<float3>& goals, float maxLen, std::vector<float>* lens);
+
+	// reduces a path (eg. from FindPath) to the waypoints at
+	// which it turns, dropping every waypoint that can be
+	// skipped by walking straight from the previous kept one
+	// over passable cells of <pathType>; the kept ones are
+	// stored as (x, z) slope-map cell pairs in <cells>, the
+	// number of waypoints is returned
+	int CompressPath(int pathType, const std::vector<float3>& path, std::vector<short>* cells);
+	// expands CompressPath's output into world-space waypoints
+	void DecodePath(const std::vector<short>& cells, std::vector<float3>* path) const;
+
+	// flow-field queries, meant for the many groups that head
+	// for the same few targets: the first query toward a cell
+	// starts a field for the (pathType, goal-cell) pair that
+	// is extended over the next frames and then answers every
+	// query from any position with a lookup; queries from cells
+	// the field has not reached yet are pending, as are all
+	// queries toward a new goal while every field is busy
+	XAIPathQueryResult GetFlowPathLength(int pathType, const float3& pos, const float3& goal, float* len);
+	// next waypoint (a few cells ahead) on the way to <goal>
+	XAIPathQueryResult GetFlowWaypoint(int pathType, const float3& pos, const float3& goal, float3* wp);
+
+	// rcb->GetPathLength, served from an LRU-cache if an
+	// equivalent query was made recently (see XAIPathLengthCache)
+	float GetPathLength(const float3&, const float3&, int pathType);
+	// frames after which cached path-lengths expire (0: never)
+	void SetPathLengthTTL(unsigned int frames);
+	// drops the cached path-lengths near a changed region
+	// (a rectangle of slope-map cells)
+	void InvalidatePathLengths(const XAIMapRect&);
+
+	// microseconds per frame spent on generating masks
+	void SetMaskFrameBudget(unsigned int usecs) { maskFrameBudget = usecs; }
+
+	// compares the ready masks against the reference labeller
+	// and the abstract graphs against flat searches, returns
+	// the number of mismatching pixels and queries
+	int SelfCheck();
+
+	// labelling of one layer of a mask-map
+	struct MaskJob {
+		MaskJob(XAIMaskMap<float>* m, unsigned int i): maskMap(m), layer(i) {}
+
+		XAIMaskMap<float>* maskMap;
+		unsigned int layer;
+	};
+
 private:
+	void UpdateMasks();
+	bool RequestMasks(int);
+
+	struct MaskJobBatch;
+	void StartMaskJobs();
+	bool FinishMaskJobs(bool);
+	static void RunMaskJobs(MaskJobBatch*);
+
+	const std::vector<unsigned int>& GetPassGrid(int);
+	const std::vector<unsigned short>& GetRegionIDs(int);
+	struct MaskEntry;
+	unsigned short NewRegionID(MaskEntry&) const;
+	void FloodRegion(MaskEntry&, int, unsigned short, unsigned short) const;
+	void RelabelRegions(int, const XAIMapRect&);
+
+	// diffs some height-map tiles against the engine's each
+	// frame and patches everything derived from the terrain
+	// within the changed rectangle (in slope-map cells)
+	void UpdateTerrain();
+	void TerrainChanged(const XAIMapRect&);
+	unsigned short GetStartRegionID(const std::vector<unsigned short>&, const float3&) const;
+	int GetGoalCell(const std::vector<unsigned int>&, const float3&) const;
+	XAICPathGraph* GetPathGraph(int);
+	float SearchGrid(const std::vector<unsigned int>&, int, int, float, float);
+	float GetCellThreat(int);
+	void AddGridPath(int, std::vector<float3>*) const;
+	float3 GetCellPos(int) const;
+	bool IsLineWalkable(const std::vector<unsigned int>&, int, int, int, int) const;
+	void PushOpenNode(int, float);
+	int PopOpenNode();
+	static float GetOctileDist(int, int, int, int);
+
+	int CheckPathGraph(int);
+
+	XAICFlowField* RequestFlowField(int, int);
+	XAIPathQueryResult GetFlowCell(int, const XAICFlowField*, const float3&, int*) const;
+	void UpdateFlowFields();
+
+	// on-disk cache of the mask-maps per distinct key, valid
+	// as long as the height-map (hash) has not changed either
+	std::string GetMaskCacheName(const XAIMoveDataKey&) const;
+	bool ReadMaskCache(XAIMaskMap<float>*, const XAIMoveDataKey&) const;
+	void WriteMaskCache(const XAIMaskMap<float>*, const XAIMoveDataKey&) const;
+
 	XAIMap<float>* xaiHeightMap;
 	XAIMap<float>* xaiSlopeMap;
 
-	// for each moveType, this stores a mask-map which indicates
-	// contiguous areas of the {H, S}map ("pixels" of equal mask)
-	// that can be traversed by a unit using that pathType
-	std::map<int, XAIMaskMap<float>* > maskMaps;
-	std::vector<XAIIPathNode*> nodes;
+	unsigned int heightMapHash;
+
+	// next height-map tile to diff against the engine's;
+	// the mask-cache is bypassed once anything changed
+	int terrainTile;
+	bool terrainChanged;
+
+	// scratch bitplanes for TerrainChanged, of which only
+	// the words covering a changed region are ever filled
+	std::vector<unsigned int> terrainSlopeBits;
+	std::vector<unsigned int> terrainHeightBits;
+
+	// steps of UpdateMasks for a queued MaskEntry
+	enum {
+		MASK_STEP_READ  = 0,
+		MASK_STEP_LABEL = 1,
+		MASK_STEP_WAIT  = 2, // labelled by the pool
+		MASK_STEP_WRITE = 3,
+		MASK_STEP_DONE  = 4,
+	};
+
+	// a mask-map indicates contiguous areas of the {H, S}map
+	// ("pixels" of equal mask) that can be traversed by units
+	// of any pathType with the same XAIMoveDataKey
+	struct MaskEntry {
+		MaskEntry(XAIMaskMap<float>* m, XAIIMapPixelFilter<float>* f, const MoveData* md):
+			maskMap(m), maskFilter(f), moveData(md), pathGraph(NULL), nextRegionID(1), ready(false), queued(false), masksStale(false) {
+			maskStep = MASK_STEP_READ;
+		}
+
+		XAIMaskMap<float>* maskMap;
+		XAIIMapPixelFilter<float>* maskFilter;
+		const MoveData* moveData; // any MoveData with this key
+
+		// passable slope-map cells, built on the first search
+		std::vector<unsigned int> passBits;
+		// abstract graph over passBits, built on the first long search
+		XAICPathGraph* pathGraph;
+		// connected region per slope-map cell (0 for impassable
+		// cells), built on the first batch-query
+		std::vector<unsigned short> regionIDs;
+		std::vector<unsigned short> freeRegionIDs;
+		unsigned int nextRegionID;
+
+		bool ready;
+		bool queued;
+		// next step of UpdateMasks while queued
+		int maskStep;
+		// set once the terrain changed the passability of
+		// any cell, the masks are freed then (or taken off
+		// the queue) and the region-IDs are used instead
+		bool masksStale;
+	};
+
+	std::vector<MaskEntry> maskEntries;
+	// maps path-types to indices into maskEntries
+	std::map<int, int> maskEntryIDs;
+	// entries whose masks are being generated, front first
+	std::list<int> maskQueue;
+
+	unsigned int maskFrameBudget;
+
+	// labelling jobs being run by the pool (or NULL)
+	MaskJobBatch* maskJobs;
+	unsigned int maskThreads;
+
+	// A* node-state per slope-map cell; entries are only
+	// valid for the current search if nodeGens[i] equals
+	// searchGen, so a search never has to clear them all
+	std::vector<float> nodeCosts;
+	std::vector<int> nodeParents;
+	std::vector<unsigned int> nodeGens;
+	std::vector<unsigned char> nodeStates;
+	unsigned int searchGen;
+
+	// threat sampled per slope-map cell, valid while the
+	// threat-map version of the cell's tile matches the
+	// one in cellThreatVers
+	std::vector<float> cellThreats;
+	std::vector<unsigned int> cellThreatVers;
+
+	XAICPathLengthCache* pathLengthCache;
+
+	// once there are XAI_FLOWFIELD_CACHE_SIZE flow-fields,
+	// a new goal reuses the least recently used idle one
+	struct FlowEntry {
+		FlowEntry(XAICFlowField* f = NULL, int n = -1): field(f), maskEntry(n), lastUse(0), useFrame(-1U) {}
+
+		XAICFlowField* field;
+		int maskEntry;
+		unsigned int lastUse;
+		unsigned int useFrame; // frame of the last query
+	};
+
+	std::vector<FlowEntry> flowEntries;
+	unsigned int flowUseCounter;
+
+	struct OpenNode {
+		OpenNode(int n = -1, float v = 0.0f): node(n), f(v) {}
+
+		int node;
+		float f;
+	};
+	std::vector<OpenNode> openHeap;
 
 	// maps path-types to MoveData instances
 	std::map<int, const MoveData*> moveDataMap;
@@ -0,0 +1,420 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+#include "./XAIPathGraph.hpp"
+#include "../map/XAIMap.hpp"
+
+// entrance runs at least this long get a node at each
+// end instead of only one in the middle
+#define XAI_PATHGRAPH_SPLIT_RUN 6
+
+static float GetOctileDist(int c0, int c1, int sx) {
+	const int dx = std::abs((c1 % sx) - (c0 % sx));
+	const int dz = std::abs((c1 / sx) - (c0 / sx));
+
+	return (std::max(dx, dz) + (M_SQRT2 - 1.0f) * std::min(dx, dz));
+}
+
+XAICPathGraph::XAICPathGraph(const std::vector<unsigned int>* bits, int sx, int sz, int cs):
+	passBits(bits), sizex(sx), sizez(sz), clusterSize(cs), searchGen(0) {
+
+	numClustersX = (sizex + clusterSize - 1) / clusterSize;
+	numClustersZ = (sizez + clusterSize - 1) / clusterSize;
+
+	clusterNodes.resize(numClustersX * numClustersZ);
+	clusterDirty.resize(numClustersX * numClustersZ, 1);
+	clusterCosts.resize(clusterSize * clusterSize, -1.0f);
+
+	// everything is built by the first Update
+	for (int c = 0; c < numClustersX * numClustersZ; c++) {
+		dirtyClusters.push_back(c);
+	}
+}
+
+void XAICPathGraph::MarkDirty(const XAIMapRect& rect) {
+	XAIMapRect r = rect;
+	r.ClipTo(sizex, sizez);
+
+	if (r.IsEmpty())
+		return;
+
+	for (int cz = (r.zmin / clusterSize); cz <= ((r.zmax - 1) / clusterSize); cz++) {
+		for (int cx = (r.xmin / clusterSize); cx <= ((r.xmax - 1) / clusterSize); cx++) {
+			const int c = cz * numClustersX + cx;
+
+			if (clusterDirty[c] == 0) {
+				clusterDirty[c] = 1;
+				dirtyClusters.push_back(c);
+			}
+		}
+	}
+}
+
+void XAICPathGraph::Update() {
+	if (dirtyClusters.empty())
+		return;
+
+	// a dirty cluster invalidates all four of its borders,
+	// and (because their entrances change) the edges of
+	// its neighbors as well
+	std::vector<int> borders;
+	std::vector<int> edgeClusters;
+
+	for (unsigned int i = 0; i < dirtyClusters.size(); i++) {
+		const int c = dirtyClusters[i];
+		const int cx = c % numClustersX;
+		const int cz = c / numClustersX;
+
+		borders.push_back(c * 2    );
+		borders.push_back(c * 2 + 1);
+		edgeClusters.push_back(c);
+
+		if (cx > 0) { borders.push_back((c - 1) * 2); edgeClusters.push_back(c - 1); }
+		if (cz > 0) { borders.push_back((c - numClustersX) * 2 + 1); edgeClusters.push_back(c - numClustersX); }
+		if ((cx + 1) < numClustersX) { edgeClusters.push_back(c + 1); }
+		if ((cz + 1) < numClustersZ) { edgeClusters.push_back(c + numClustersX); }
+
+		clusterDirty[c] = 0;
+	}
+
+	dirtyClusters.clear();
+
+	std::sort(borders.begin(), borders.end());
+	std::sort(edgeClusters.begin(), edgeClusters.end());
+	borders.erase(std::unique(borders.begin(), borders.end()), borders.end());
+	edgeClusters.erase(std::unique(edgeClusters.begin(), edgeClusters.end()), edgeClusters.end());
+
+	for (unsigned int i = 0; i < borders.size(); i++) {
+		RebuildBorder(borders[i]);
+	}
+	for (unsigned int i = 0; i < edgeClusters.size(); i++) {
+		RebuildEdges(edgeClusters[i]);
+	}
+}
+
+
+
+int XAICPathGraph::AddNode(int cell, int cluster, int border) {
+	int n = nodes.size();
+
+	if (!freeNodes.empty()) {
+		n = freeNodes.back(); freeNodes.pop_back();
+	} else {
+		nodes.push_back(Node());
+	}
+
+	nodes[n].cell    = cell;
+	nodes[n].cluster = cluster;
+	nodes[n].border  = border;
+	nodes[n].partner = -1;
+	nodes[n].alive   = true;
+
+	clusterNodes[cluster].push_back(n);
+	return n;
+}
+
+void XAICPathGraph::DelNode(int n) {
+	std::vector<int>& cn = clusterNodes[nodes[n].cluster];
+
+	cn.erase(std::remove(cn.begin(), cn.end(), n), cn.end());
+
+	nodes[n].alive = false;
+	nodes[n].edges.clear();
+	freeNodes.push_back(n);
+}
+
+// (re-)places the entrances on the right (even <border>)
+// or bottom (odd <border>) side of cluster <border> / 2
+void XAICPathGraph::RebuildBorder(int border) {
+	const int c = border >> 1;
+	const int cx = c % numClustersX;
+	const int cz = c / numClustersX;
+	const bool bottom = ((border & 1) != 0);
+
+	// the neighbor across the border, if any
+	const int nc = bottom? (c + numClustersX): (c + 1);
+
+	if ( bottom && (cz + 1) >= numClustersZ) { return; }
+	if (!bottom && (cx + 1) >= numClustersX) { return; }
+
+	for (int k = 0; k < 2; k++) {
+		const std::vector<int> cn = clusterNodes[(k == 0)? c: nc];
+
+		for (unsigned int i = 0; i < cn.size(); i++) {
+			if (nodes[cn[i]].border == border) {
+				DelNode(cn[i]);
+			}
+		}
+	}
+
+	// cells on either side of the border are at <in> and
+	// <in + step> (in the neighbor), consecutive ones along
+	// it <stride> apart
+	const int len    = bottom? (std::min((cx + 1) * clusterSize, sizex) - cx * clusterSize): (std::min((cz + 1) * clusterSize, sizez) - cz * clusterSize);
+	const int first  = bottom? (((cz + 1) * clusterSize - 1) * sizex + cx * clusterSize): (cz * clusterSize * sizex + (cx + 1) * clusterSize - 1);
+	const int step   = bottom? sizex: 1;
+	const int stride = bottom? 1: sizex;
+
+	int runStart = -1;
+
+	for (int i = 0; i <= len; i++) {
+		const int in = first + i * stride;
+		const bool open = (i < len && IsPassable(in) && IsPassable(in + step));
+
+		if (open) {
+			if (runStart < 0) {
+				runStart = i;
+			}
+			continue;
+		}
+
+		if (runStart < 0) {
+			continue;
+		}
+
+		const int runLen = i - runStart;
+		const int ends[2] = {runStart, i - 1};
+		const int mids[1] = {runStart + (runLen >> 1)};
+		const int* offsets = (runLen >= XAI_PATHGRAPH_SPLIT_RUN)? ends: mids;
+		const int numOffsets = (runLen >= XAI_PATHGRAPH_SPLIT_RUN)? 2: 1;
+
+		for (int j = 0; j < numOffsets; j++) {
+			const int cell = first + offsets[j] * stride;
+			const int a = AddNode(cell, c, border);
+			const int b = AddNode(cell + step, nc, border);
+
+			nodes[a].partner = b;
+			nodes[b].partner = a;
+		}
+
+		runStart = -1;
+	}
+}
+
+void XAICPathGraph::RebuildEdges(int cluster) {
+	const std::vector<int>& cn = clusterNodes[cluster];
+
+	for (unsigned int i = 0; i < cn.size(); i++) {
+		Node& node = nodes[cn[i]];
+
+		node.edges.clear();
+
+		SearchCluster(cluster, node.cell);
+
+		for (unsigned int j = 0; j < cn.size(); j++) {
+			if (i == j)
+				continue;
+
+			const float cost = GetClusterCost(cluster, nodes[cn[j]].cell);
+
+			if (cost >= 0.0f) {
+				node.edges.push_back(Edge(cn[j], cost));
+			}
+		}
+	}
+}
+
+// Dijkstra from <srcCell> that never leaves the cluster,
+// leaves the cost to every reachable cell (or -1) in
+// clusterCosts; the source itself need not be passable
+void XAICPathGraph::SearchCluster(int cluster, int srcCell) {
+	static const int   dirX[8] = {1, -1,  0,  0,  1, -1,  1, -1};
+	static const int   dirZ[8] = {0,  0,  1, -1,  1,  1, -1, -1};
+	static const float dirC[8] = {1.0f, 1.0f, 1.0f, 1.0f, M_SQRT2, M_SQRT2, M_SQRT2, M_SQRT2};
+
+	const int x0 = (cluster % numClustersX) * clusterSize;
+	const int z0 = (cluster / numClustersX) * clusterSize;
+	const int x1 = std::min(x0 + clusterSize, sizex);
+	const int z1 = std::min(z0 + clusterSize, sizez);
+
+	std::fill(clusterCosts.begin(), clusterCosts.end(), -1.0f);
+
+	Queue q;
+	q.push(QueueItem(0.0f, srcCell));
+	clusterCosts[((srcCell / sizex) - z0) * clusterSize + ((srcCell % sizex) - x0)] = 0.0f;
+
+	while (!q.empty()) {
+		const QueueItem item = q.top(); q.pop();
+
+		const int x = item.second % sizex;
+		const int z = item.second / sizex;
+
+		if (item.first > clusterCosts[(z - z0) * clusterSize + (x - x0)])
+			continue;
+
+		for (int d = 0; d < 8; d++) {
+			const int nx = x + dirX[d];
+			const int nz = z + dirZ[d];
+
+			if (nx < x0 || nx >= x1) { continue; }
+			if (nz < z0 || nz >= z1) { continue; }
+
+			if (!IsPassable(nz * sizex + nx)) {
+				continue;
+			}
+			// no cutting corners on diagonal moves
+			if (d >= 4 && (!IsPassable(z * sizex + nx) || !IsPassable(nz * sizex + x))) {
+				continue;
+			}
+
+			const int li = (nz - z0) * clusterSize + (nx - x0);
+			const float g = item.first + dirC[d];
+
+			if (clusterCosts[li] >= 0.0f && clusterCosts[li] <= g) {
+				continue;
+			}
+
+			clusterCosts[li] = g;
+			q.push(QueueItem(g, nz * sizex + nx));
+		}
+	}
+}
+
+float XAICPathGraph::GetClusterCost(int cluster, int cell) const {
+	const int x0 = (cluster % numClustersX) * clusterSize;
+	const int z0 = (cluster / numClustersX) * clusterSize;
+
+	return (clusterCosts[((cell / sizex) - z0) * clusterSize + ((cell % sizex) - x0)]);
+}
+
+
+
+// the start and goal are temporary nodes numbered past
+// the real ones (nodes.size() and nodes.size() + 1)
+int XAICPathGraph::GetNodeCell(int n, int startCell, int goalCell) const {
+	if (n == int(nodes.size())    ) { return startCell; }
+	if (n == int(nodes.size()) + 1) { return goalCell;  }
+	return nodes[n].cell;
+}
+
+void XAICPathGraph::RelaxNode(Queue& q, int node, int parent, float g, int cell, int goalCell) {
+	if (nodeGens[node] == searchGen && nodeCosts[node] <= g)
+		return;
+
+	nodeGens[node]    = searchGen;
+	nodeCosts[node]   = g;
+	nodeParents[node] = parent;
+
+	q.push(QueueItem(g + GetOctileDist(cell, goalCell, sizex), node));
+}
+
+float XAICPathGraph::FindPath(int startCell, int goalCell, std::vector<int>* cells) {
+	Update();
+
+	if (!IsPassable(goalCell))
+		return -1.0f;
+
+	const int startCluster = ((startCell / sizex) / clusterSize) * numClustersX + ((startCell % sizex) / clusterSize);
+	const int goalCluster  = (( goalCell / sizex) / clusterSize) * numClustersX + (( goalCell % sizex) / clusterSize);
+
+	const int startNode = nodes.size();
+	const int goalNode  = nodes.size() + 1;
+
+	nodeCosts.resize(nodes.size() + 2, 0.0f);
+	nodeParents.resize(nodes.size() + 2, -1);
+	nodeGens.resize(nodes.size() + 2, 0);
+
+	if ((searchGen += 1) == 0) {
+		std::fill(nodeGens.begin(), nodeGens.end(), 0);
+		searchGen = 1;
+	}
+
+	// connect the goal to the entrances of its cluster
+	// (costs are symmetric, so searching from the goal
+	// gives the cost of reaching it from each entrance)
+	std::vector<Edge> goalEdges;
+	std::vector<Edge> startEdges;
+
+	SearchCluster(goalCluster, goalCell);
+
+	for (unsigned int i = 0; i < clusterNodes[goalCluster].size(); i++) {
+		const int n = clusterNodes[goalCluster][i];
+		const float cost = GetClusterCost(goalCluster, nodes[n].cell);
+
+		if (cost >= 0.0f) {
+			goalEdges.push_back(Edge(n, cost));
+		}
+	}
+
+	if (startCluster == goalCluster) {
+		const float cost = GetClusterCost(goalCluster, startCell);
+
+		if (cost >= 0.0f) {
+			startEdges.push_back(Edge(goalNode, cost));
+		}
+	}
+
+	SearchCluster(startCluster, startCell);
+
+	for (unsigned int i = 0; i < clusterNodes[startCluster].size(); i++) {
+		const int n = clusterNodes[startCluster][i];
+		const float cost = GetClusterCost(startCluster, nodes[n].cell);
+
+		if (cost >= 0.0f) {
+			startEdges.push_back(Edge(n, cost));
+		}
+	}
+
+	Queue q;
+	RelaxNode(q, startNode, -1, 0.0f, startCell, goalCell);
+
+	bool found = false;
+
+	while (!q.empty()) {
+		const QueueItem item = q.top(); q.pop();
+		const int n = item.second;
+		const int cell = GetNodeCell(n, startCell, goalCell);
+
+		// skip stale entries
+		if (item.first > (nodeCosts[n] + GetOctileDist(cell, goalCell, sizex) + 0.001f))
+			continue;
+
+		if (n == goalNode) {
+			found = true; break;
+		}
+
+		const float g = nodeCosts[n];
+
+		if (n == startNode) {
+			for (unsigned int i = 0; i < startEdges.size(); i++) {
+				const int m = startEdges[i].node;
+				RelaxNode(q, m, n, g + startEdges[i].cost, GetNodeCell(m, startCell, goalCell), goalCell);
+			}
+			continue;
+		}
+
+		const Node& node = nodes[n];
+
+		for (unsigned int i = 0; i < node.edges.size(); i++) {
+			const int m = node.edges[i].node;
+			RelaxNode(q, m, n, g + node.edges[i].cost, nodes[m].cell, goalCell);
+		}
+
+		// partners are orthogonal neighbors
+		RelaxNode(q, node.partner, n, g + 1.0f, nodes[node.partner].cell, goalCell);
+
+		if (node.cluster == goalCluster) {
+			for (unsigned int i = 0; i < goalEdges.size(); i++) {
+				if (goalEdges[i].node == n) {
+					RelaxNode(q, goalNode, n, g + goalEdges[i].cost, goalCell, goalCell);
+				}
+			}
+		}
+	}
+
+	if (!found)
+		return -1.0f;
+
+	if (cells != NULL) {
+		cells->clear();
+
+		for (int n = goalNode; n != -1; n = nodeParents[n]) {
+			cells->push_back(GetNodeCell(n, startCell, goalCell));
+		}
+
+		std::reverse(cells->begin(), cells->end());
+	}
+
+	return nodeCosts[goalNode];
+}
@@ -0,0 +1,96 @@
+#ifndef XAI_PATHGRAPH_HDR
+#define XAI_PATHGRAPH_HDR
+
+#include <functional>
+#include <queue>
+#include <utility>
+#include <vector>
+
+struct XAIMapRect;
+
+// HPA*-style abstract graph over a grid of passable cells
+// (one bit per cell, see XAICPathFinder::GetPassGrid) for
+// long-distance queries: the grid is divided into square
+// clusters, pairs of entrance nodes are placed wherever two
+// neighboring clusters are connected across their border,
+// and the shortest intra-cluster distances between all of
+// a cluster's entrances are stored as edges
+class XAICPathGraph {
+public:
+	XAICPathGraph(const std::vector<unsigned int>* bits, int sx, int sz, int cs);
+
+	// marks the clusters overlapping <r> (in cells) as
+	// needing to be rebuilt, which happens on the next
+	// call to Update (or FindPath)
+	void MarkDirty(const XAIMapRect& r);
+	// rebuilds the entrances and edges of dirty clusters
+	void Update();
+
+	// A* over the abstract graph, returns the path cost (in
+	// cells) or -1; <cells> is filled with the start cell,
+	// the entrance cells passed through and the goal cell
+	float FindPath(int startCell, int goalCell, std::vector<int>* cells);
+
+	int GetClusterSize() const { return clusterSize; }
+	int GetNumNodes() const { return (nodes.size() - freeNodes.size()); }
+
+private:
+	struct Edge {
+		Edge(int n = -1, float c = 0.0f): node(n), cost(c) {}
+
+		int node;
+		float cost;
+	};
+	struct Node {
+		Node(): cell(-1), cluster(-1), border(-1), partner(-1), alive(false) {}
+
+		int cell;
+		int cluster;
+		int border;  // 2 * cluster (+1 for the bottom border)
+		int partner; // entrance node across the border
+		bool alive;
+
+		std::vector<Edge> edges; // to nodes of the same cluster
+	};
+
+	bool IsPassable(int cell) const {
+		return ((((*passBits)[cell >> 5] >> (cell & 31)) & 1) != 0);
+	}
+
+	int AddNode(int cell, int cluster, int border);
+	void DelNode(int n);
+	void RebuildBorder(int border);
+	void RebuildEdges(int cluster);
+	void SearchCluster(int cluster, int srcCell);
+	float GetClusterCost(int cluster, int cell) const;
+	int GetNodeCell(int n, int startCell, int goalCell) const;
+
+	const std::vector<unsigned int>* passBits;
+
+	int sizex, sizez;     // grid dimensions (in cells)
+	int clusterSize;      // cluster width and height (in cells)
+	int numClustersX;
+	int numClustersZ;
+
+	std::vector<Node> nodes;
+	std::vector<int> freeNodes;
+	std::vector<std::vector<int> > clusterNodes;
+
+	std::vector<unsigned char> clusterDirty;
+	std::vector<int> dirtyClusters;
+
+	typedef std::pair<float, int> QueueItem;
+	typedef std::priority_queue<QueueItem, std::vector<QueueItem>, std::greater<QueueItem> > Queue;
+
+	void RelaxNode(Queue&, int node, int parent, float g, int cell, int goalCell);
+
+	// scratch-space for SearchCluster (one entry per cell
+	// of a cluster) and for the searches in FindPath
+	std::vector<float> clusterCosts;
+	std::vector<float> nodeCosts;
+	std::vector<int> nodeParents;
+	std::vector<unsigned int> nodeGens;
+	unsigned int searchGen;
+};
+
+#endif
@@ -0,0 +1,172 @@
+#include <algorithm>
+
+#include "./XAIPathLengthCache.hpp"
+#include "../map/XAIMap.hpp"
+#include "../utils/XAIUtil.hpp"
+
+XAICPathLengthCache::XAICPathLengthCache(int sx, int sz, int sq, unsigned int capacity, unsigned int ttl):
+	sizex(sx), sizez(sz), startQuant(std::max(sq, 1)), head(-1), tail(-1), entryTTL(ttl), numHits(0), numMisses(0) {
+
+	unsigned int numBuckets = 1;
+
+	// at least two buckets per entry, power of two
+	while (numBuckets < (capacity << 1)) {
+		numBuckets <<= 1;
+	}
+
+	entries.resize(std::max(capacity, 1U));
+	buckets.resize(numBuckets, -1);
+	freeEntries.reserve(entries.size());
+
+	for (int e = int(entries.size()) - 1; e >= 0; e--) {
+		freeEntries.push_back(e);
+	}
+}
+
+bool XAICPathLengthCache::Get(int pathType, int startCell, int goalCell, unsigned int frame, float* len) {
+	const int e = Find(pathType, QuantizeStart(startCell), goalCell);
+
+	if (e == -1) {
+		numMisses += 1; return false;
+	}
+
+	if (entryTTL > 0 && (frame - entries[e].frame) > entryTTL) {
+		Remove(e);
+		numMisses += 1; return false;
+	}
+
+	// move to the front of the LRU-list
+	Unlink(e);
+	Link(e);
+
+	*len = entries[e].length;
+	numHits += 1;
+	return true;
+}
+
+void XAICPathLengthCache::Put(int pathType, int startCell, int goalCell, unsigned int frame, float len) {
+	const int qStartCell = QuantizeStart(startCell);
+
+	int e = Find(pathType, qStartCell, goalCell);
+
+	if (e != -1) {
+		Remove(e);
+	}
+	if (freeEntries.empty()) {
+		// evict the least recently used entry
+		Remove(tail);
+	}
+
+	e = freeEntries.back();
+	freeEntries.pop_back();
+
+	Entry& entry = entries[e];
+	entry.pathType  = pathType;
+	entry.startCell = qStartCell;
+	entry.goalCell  = goalCell;
+	entry.length    = len;
+	entry.frame     = frame;
+
+	const unsigned int b = GetBucket(pathType, qStartCell, goalCell);
+
+	entry.hashNext = buckets[b];
+	buckets[b] = e;
+
+	Link(e);
+}
+
+void XAICPathLengthCache::Invalidate(const XAIMapRect& r) {
+	for (int e = head; e != -1; ) {
+		const Entry& entry = entries[e];
+		const int next = entry.next;
+
+		// start-cells cover a startQuant^2 block
+		const int sx = (entry.startCell % sizex) * startQuant;
+		const int sz = (entry.startCell / sizex) * startQuant;
+		const int gx = (entry.goalCell % sizex);
+		const int gz = (entry.goalCell / sizex);
+
+		const int xmin = std::min(sx, gx), xmax = std::max(sx + startQuant, gx + 1);
+		const int zmin = std::min(sz, gz), zmax = std::max(sz + startQuant, gz + 1);
+
+		if (xmin < r.xmax && xmax > r.xmin && zmin < r.zmax && zmax > r.zmin) {
+			Remove(e);
+		}
+
+		e = next;
+	}
+}
+
+void XAICPathLengthCache::Clear() {
+	while (head != -1) {
+		Remove(head);
+	}
+}
+
+
+
+// the quantized cell is still indexed by sizex so that
+// it can be converted back to the block it stands for
+int XAICPathLengthCache::QuantizeStart(int cell) const {
+	return (((cell / sizex) / startQuant) * sizex + ((cell % sizex) / startQuant));
+}
+
+unsigned int XAICPathLengthCache::GetBucket(int pathType, int startCell, int goalCell) const {
+	const int key[3] = {pathType, startCell, goalCell};
+
+	return (XAIUtil::HashBytes(XAI_HASH_SEED, key, sizeof(key)) & (buckets.size() - 1));
+}
+
+int XAICPathLengthCache::Find(int pathType, int startCell, int goalCell) const {
+	for (int e = buckets[GetBucket(pathType, startCell, goalCell)]; e != -1; e = entries[e].hashNext) {
+		const Entry& entry = entries[e];
+
+		if (entry.pathType == pathType && entry.startCell == startCell && entry.goalCell == goalCell) {
+			return e;
+		}
+	}
+
+	return -1;
+}
+
+// inserts <e> at the front of the LRU-list
+void XAICPathLengthCache::Link(int e) {
+	entries[e].prev = -1;
+	entries[e].next = head;
+
+	if (head != -1) {
+		entries[head].prev = e;
+	} else {
+		tail = e;
+	}
+
+	head = e;
+}
+
+void XAICPathLengthCache::Unlink(int e) {
+	const int prev = entries[e].prev;
+	const int next = entries[e].next;
+
+	if (prev != -1) { entries[prev].next = next; } else { head = next; }
+	if (next != -1) { entries[next].prev = prev; } else { tail = prev; }
+
+	entries[e].prev = -1;
+	entries[e].next = -1;
+}
+
+// unlinks <e> from both its bucket and the LRU-list
+void XAICPathLengthCache::Remove(int e) {
+	Entry& entry = entries[e];
+	int* link = &buckets[GetBucket(entry.pathType, entry.startCell, entry.goalCell)];
+
+	while (*link != e) {
+		link = &entries[*link].hashNext;
+	}
+
+	*link = entry.hashNext;
+	entry.hashNext = -1;
+	entry.pathType = -1;
+
+	Unlink(e);
+	freeEntries.push_back(e);
+}
@@ -0,0 +1,76 @@
+#ifndef XAI_PATHLENGTHCACHE_HDR
+#define XAI_PATHLENGTHCACHE_HDR
+
+#include <vector>
+
+struct XAIMapRect;
+
+// LRU cache of path-lengths keyed by (pathType, start cell,
+// goal cell) where the start cell is quantized more coarsely
+// than the goal cell (groups move, resource spots do not);
+// entries are also dropped when they are older than the TTL
+// (in frames, 0 means never) or when Invalidate is told that
+// their region changed, and all operations are O(1) except
+// for Invalidate (which scans every entry)
+//
+// all cells are slope-map cells
+class XAICPathLengthCache {
+public:
+	XAICPathLengthCache(int sx, int sz, int startQuant, unsigned int capacity, unsigned int ttl);
+
+	// returns true (and the length in <len>) if a fresh
+	// entry exists, making it the most recently used one
+	bool Get(int pathType, int startCell, int goalCell, unsigned int frame, float* len);
+	void Put(int pathType, int startCell, int goalCell, unsigned int frame, float len);
+
+	// drops all entries whose start- and goal-cells span a
+	// rectangle that overlaps <r> (paths that make a detour
+	// outside of it are only caught by the TTL)
+	void Invalidate(const XAIMapRect& r);
+	void Clear();
+
+	void SetTTL(unsigned int ttl) { entryTTL = ttl; }
+
+	unsigned int GetNumHits() const { return numHits; }
+	unsigned int GetNumMisses() const { return numMisses; }
+
+private:
+	struct Entry {
+		Entry(): pathType(-1), startCell(-1), goalCell(-1), length(0.0f), frame(0) {
+			prev = -1; next = -1; hashNext = -1;
+		}
+
+		int pathType;
+		int startCell; // quantized
+		int goalCell;
+		float length;
+		unsigned int frame; // when the length was stored
+
+		int prev, next; // LRU-list links (prev is more recent)
+		int hashNext;   // next entry in the same bucket
+	};
+
+	int QuantizeStart(int cell) const;
+	unsigned int GetBucket(int pathType, int startCell, int goalCell) const;
+	int Find(int pathType, int startCell, int goalCell) const;
+
+	void Link(int e);
+	void Unlink(int e);
+	void Remove(int e);
+
+	int sizex, sizez;
+	int startQuant;
+
+	std::vector<Entry> entries;
+	std::vector<int> buckets;   // first entry per bucket (or -1)
+	std::vector<int> freeEntries;
+
+	int head; // most recently used entry
+	int tail; // least recently used entry
+
+	unsigned int entryTTL;
+	unsigned int numHits;
+	unsigned int numMisses;
+};
+
+#endif
@@ -1,4 +1,6 @@
 #include <cassert>
+#include <algorithm>
+#include <vector>
 
 #include "LegacyCpp/IAICallback.h"
 #include "LegacyCpp/IAICheats.h"
@@ -10,6 +12,25 @@
 #include "../units/XAIUnitDef.hpp"
 #include "../units/XAIUnit.hpp"
 #include "../map/XAIThreatMap.hpp"
+#include "../path/XAIPathFinder.hpp"
+
+// size (in elmos) of the grid that flow-field goals are
+// rounded to, so a moving attackee only needs a new field
+// once it leaves its grid cell rather than every slope cell
+#define XAI_ATTACK_GOAL_GRID 128
+// groups that head for an attackee out of LOS are routed
+// around threat: a cell whose threat equals the group's
+// power costs (1 + XAI_ATTACK_ROUTE_THREAT_COST) times as
+// much to cross and the search may return routes up to
+// XAI_ATTACK_ROUTE_WEIGHT times as costly as the best one
+#define XAI_ATTACK_ROUTE_THREAT_COST 4.0f
+#define XAI_ATTACK_ROUTE_WEIGHT 1.5f
+// routes are kept (compressed) for XAI_ATTACK_ROUTE_TTL
+// frames or until the attackee leaves its goal-grid cell,
+// a waypoint counts as reached within XAI_ATTACK_ROUTE_DIST
+// elmos
+#define XAI_ATTACK_ROUTE_TTL (GAME_SPEED * 10)
+#define XAI_ATTACK_ROUTE_DIST 128.0f
 
 void XAIAttackTask::AddGroupMember(XAIGroup* g) {
 	if (groups.empty()) {
@@ -24,6 +45,12 @@ void XAIAttackTask::AddGroupMember(XAIGroup* g) {
 	g->GiveCommand(cmd);
 }
 
+void XAIAttackTask::DelGroupMember(XAIGroup* g) {
+	routes.erase(g->GetID());
+
+	this->XAIITask::DelGroupMember(g);
+}
+
 bool XAIAttackTask::CanAddGroupMember(XAIGroup* g) {
 	if (tAttackeeUnitID == -1) {
 		return false;
@@ -63,7 +90,24 @@ bool XAIAttackTask::CanAddGroupMember(XAIGroup* g) {
 		return false;
 	}
 
-	const float gETA = g->GetPositionETA(xaih->ccb->GetUnitPos(tAttackeeUnitID));
+	const float3& attackeePos = xaih->ccb->GetUnitPos(tAttackeeUnitID);
+
+	float gDist = 0.0f;
+	float gETA  = 0.0f;
+
+	// every group that considers this task heads for the
+	// same attackee, so they can share one flow-field (it
+	// is built toward the center of the attackee's grid
+	// cell and the rest of the way is taken as straight)
+	const float3 goalPos = GetGoalPos(attackeePos);
+
+	if (g->GetPathType() != -1 && xaih->pathFinder->GetFlowPathLength(g->GetPathType(), g->GetPos(), goalPos, &gDist) == XAI_PATH_POSSIBLE) {
+		gDist += goalPos.distance(attackeePos);
+		gETA = gDist / ((g->GetMaxMoveSpeed() / GAME_SPEED) + 0.01f);
+	} else {
+		// no field yet (or it is still being built)
+		gETA = g->GetPositionETA(attackeePos);
+	}
 	const float dETA = (xaih->ccb->GetUnitMaxHealth(tAttackeeUnitID) - xaih->ccb->GetUnitHealth(tAttackeeUnitID)) / (age + 1);
 
 	if (gETA < 0.0f) {
@@ -109,11 +153,13 @@ bool XAIAttackTask::Update() {
 		// attack orders fail and cause a massive spike of UnitIdle()
 		// events
 		if (xaih->rcb->GetUnitDef(tAttackeeUnitID) != sAttackeeUnitDef) {
-			cmdAux.params[0] = attackeePos.x;
-			cmdAux.params[1] = attackeePos.y;
-			cmdAux.params[2] = attackeePos.z;
-
 			for (std::set<XAIGroup*>::iterator git = groups.begin(); git != groups.end(); git++) {
+				const float3 movePos = GetRoutePos(*git, attackeePos);
+
+				cmdAux.params[0] = movePos.x;
+				cmdAux.params[1] = movePos.y;
+				cmdAux.params[2] = movePos.z;
+
 				(*git)->GiveCommand(cmdAux);
 				tPower += (*git)->GetPower();
 			}
@@ -131,3 +177,64 @@ bool XAIAttackTask::Update() {
 	tAttackProgress = (1.0f - (tAttackeeCurHealth / tAttackeeMaxHealth));
 	return (tAttackProgress >= 1.0f || (tPower > 0.0f && xaih->threatMap->GetThreat(attackeePos) > tPower));
 }
+
+// rounds <pos> to the center of its goal-grid cell
+float3 XAIAttackTask::GetGoalPos(const float3& pos) const {
+	return float3(
+		int(pos.x / XAI_ATTACK_GOAL_GRID) * XAI_ATTACK_GOAL_GRID + XAI_ATTACK_GOAL_GRID * 0.5f,
+		pos.y,
+		int(pos.z / XAI_ATTACK_GOAL_GRID) * XAI_ATTACK_GOAL_GRID + XAI_ATTACK_GOAL_GRID * 0.5f
+	);
+}
+
+// returns the position <g> should move to next on its way
+// to <attackeePos> (which it is sent to directly if there
+// is no route for it); routes are stored compressed to the
+// waypoints at which they turn, so each move goes as far
+// as the route does in a straight line
+float3 XAIAttackTask::GetRoutePos(const XAIGroup* g, const float3& attackeePos) {
+	if (g->GetPathType() == -1) {
+		return attackeePos;
+	}
+
+	const float3 goalPos = GetGoalPos(attackeePos);
+	const unsigned int frame = xaih->GetCurrFrame();
+
+	AttackRoute& r = routes[g->GetID()];
+
+	if (r.cells.empty() || r.goalPos != goalPos || (frame - r.frame) >= XAI_ATTACK_ROUTE_TTL) {
+		std::vector<float3> path;
+
+		const float threatCost = XAI_ATTACK_ROUTE_THREAT_COST / std::max(g->GetPower(), 1.0f);
+		const float pathLen = xaih->pathFinder->FindPath(g->GetPathType(), g->GetPos(), goalPos, &path, threatCost, XAI_ATTACK_ROUTE_WEIGHT);
+
+		r.goalPos = goalPos;
+		r.frame = frame;
+		r.next = 0;
+
+		if (pathLen < 0.0f) {
+			r.cells.clear();
+		} else {
+			xaih->pathFinder->CompressPath(g->GetPathType(), path, &r.cells);
+		}
+	}
+
+	if (r.cells.empty()) {
+		return attackeePos;
+	}
+
+	std::vector<float3> waypoints;
+	xaih->pathFinder->DecodePath(r.cells, &waypoints);
+
+	// skip the waypoints the group has already reached
+	while ((r.next + 1) < waypoints.size() && waypoints[r.next].distance(g->GetPos()) < XAI_ATTACK_ROUTE_DIST) {
+		r.next += 1;
+	}
+
+	if ((r.next + 1) >= waypoints.size()) {
+		// the last leg ends at the attackee itself
+		return attackeePos;
+	}
+
+	return waypoints[r.next];
+}
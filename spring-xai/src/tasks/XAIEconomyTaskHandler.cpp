@@ -1,5 +1,6 @@
 #include <cassert>
 #include <sstream>
+#include <vector>
 
 #include "LegacyCpp/IAICallback.h"
 #include "LegacyCpp/IAICheats.h"
@@ -30,6 +31,7 @@
 #include "../utils/XAIRNG.hpp"
 #include "../utils/XAIUtil.hpp"
 #include "../map/XAIThreatMap.hpp"
+#include "../path/XAIPathFinder.hpp"
 
 void XAICEconomyTaskHandler::OnEvent(const XAIIEvent* e) {
 	XAICScopedTimer t("[XAICEconomyTaskHandler::OnEvent]", xaih->timer);
@@ -1022,7 +1024,13 @@ float3 XAICEconomyTaskHandler::GetTaskPositionFor(const XAIUnitDef* def, const X
 				if (g->GetPathType() == -1) {
 					curResDstSq = (res->pos - g->GetPos()).SqLength();
 				} else {
-					curResDstSq = xaih->rcb->GetPathLength(g->GetPos(), res->pos, g->GetPathType());
+					// spare the path-length query for spots
+					// on a different island or plateau
+					if (xaih->pathFinder->IsPathPossible(g, g->GetPos(), res->pos) == XAI_PATH_IMPOSSIBLE) {
+						continue;
+					}
+
+					curResDstSq = xaih->pathFinder->GetPathLength(g->GetPos(), res->pos, g->GetPathType());
 					curResDstSq *= curResDstSq;
 				}
 
@@ -1234,8 +1242,49 @@ void XAICEconomyTaskHandler::GetReachableResources(
 	ResDstPairLst* reachableResources
 ) {
 	// gather all resources reachable by group <g> in at most <maxETA> frames
-	// better: get <N> closest positions, or all positions within distance <R>
-	for (ResLstIt extResPosIt = extResPositions.begin(); extResPosIt != extResPositions.end(); extResPosIt++) {
+	// (for ground-units with one search that stops at the ETA-radius, rather
+	// than one path-length query per resource)
+	std::vector<float> resPathLens;
+
+	if (g->IsMobile() && g->GetPathType() != -1) {
+		std::vector<float3> resPositions;
+		std::vector<unsigned char> resReachable;
+		resPositions.reserve(extResPositions.size());
+
+		for (ResLstIt extResPosIt = extResPositions.begin(); extResPosIt != extResPositions.end(); extResPosIt++) {
+			resPositions.push_back((*extResPosIt)->pos);
+		}
+
+		// only spots in the group's own region are searched
+		// for, so the search can stop as soon as all of those
+		// are settled instead of exhausting the ETA-radius
+		xaih->pathFinder->IsPathPossibleBatch(g, resPositions, &resReachable);
+
+		std::vector<float3> reachablePositions;
+		std::vector<float> reachablePathLens;
+
+		for (unsigned int i = 0; i < resPositions.size(); i++) {
+			if (resReachable[i] != 0) {
+				reachablePositions.push_back(resPositions[i]);
+			}
+		}
+
+		const float maxPathLen = (maxETA / GAME_SPEED) * g->GetMaxMoveSpeed();
+
+		if (xaih->pathFinder->GetPathLengths(g->GetPathType(), g->GetPos(), reachablePositions, maxPathLen, &reachablePathLens)) {
+			resPathLens.resize(resPositions.size(), -1.0f);
+
+			for (unsigned int i = 0, j = 0; i < resPositions.size(); i++) {
+				if (resReachable[i] != 0) {
+					resPathLens[i] = reachablePathLens[j++];
+				}
+			}
+		}
+	}
+
+	unsigned int resIdx = 0;
+
+	for (ResLstIt extResPosIt = extResPositions.begin(); extResPosIt != extResPositions.end(); extResPosIt++, resIdx++) {
 		const XAIIResource* res = *extResPosIt;
 		const float resDst = (res->pos - g->GetPos()).Length();
 
@@ -1250,7 +1299,12 @@ void XAICEconomyTaskHandler::GetReachableResources(
 					reachableResources->push_back(ResDstPair(*extResPosIt, resDst));
 				}
 			} else {
-				resPathLen = xaih->rcb->GetPathLength(g->GetPos(), res->pos, g->GetPathType());
+				if (!resPathLens.empty()) {
+					resPathLen = resPathLens[resIdx];
+				} else {
+					resPathLen = xaih->pathFinder->GetPathLength(g->GetPos(), res->pos, g->GetPathType());
+				}
+
 				resGroupETA = resPathLen / g->GetMaxMoveSpeed(); 
 
 				if (resPathLen >= 0.0f && resGroupETA <= (maxETA / GAME_SPEED)) {
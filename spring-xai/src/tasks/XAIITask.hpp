@@ -1,7 +1,9 @@
 #ifndef XAI_ITASK_HDR
 #define XAI_ITASK_HDR
 
+#include <map>
 #include <set>
+#include <vector>
 
 #include "Sim/Units/CommandAI/Command.h"
 #include "System/float3.h"
@@ -141,6 +143,7 @@ public:
 	}
 
 	void AddGroupMember(XAIGroup*);
+	void DelGroupMember(XAIGroup*);
 	bool CanAddGroupMember(XAIGroup*);
 
 	bool Update();
@@ -148,8 +151,25 @@ public:
 	int GetObjectID() const { return tAttackeeUnitID; }
 
 private:
+	float3 GetGoalPos(const float3&) const;
+	float3 GetRoutePos(const XAIGroup*, const float3&);
+
+	// threat-avoiding route of a group toward the attackee,
+	// as (x, z) slope-map cells of its turning points (see
+	// XAICPathFinder::CompressPath)
+	struct AttackRoute {
+		AttackRoute(): frame(0), next(0) {}
+
+		std::vector<short> cells;
+		float3 goalPos;
+		unsigned int frame;
+		unsigned int next;
+	};
+
 	int tAttackeeUnitID;
 	float tAttackProgress;
+
+	std::map<int, AttackRoute> routes;
 };
 
 struct XAIDefendTask: public XAIITask {
@@ -199,6 +199,7 @@ private:
 
 	int GetBestAttackeeIDForGroup(XAIGroup*, const XAIAttackTaskListItem*);
 	int GetBestDefendeeIDForGroup(XAIGroup*, const XAIAttackTaskListItem*);
+	void UpdateReachableEnemyRows(const XAIGroup*);
 
 	std::set<int> enemyUnitIDsInLOS;
 	std::set<int> enemyUnitIDsInRDR;
@@ -212,6 +213,11 @@ private:
 
 	std::vector<int> enemyUnitIDs;
 
+	// per enemy-snapshot row, whether the group being
+	// matched to an attackee can reach it (non-zero)
+	std::vector<float3> reachableEnemyPositions;
+	std::vector<unsigned char> reachableEnemyRows;
+
 	// maps each enemy unitID to the number of attack tasks
 	// assigned to destroy the unit corresponding to the ID
 	std::map<int, int> attackTaskCountsForUnitID;
@@ -15,6 +15,8 @@
 #include "../utils/XAITimer.hpp"
 #include "../utils/XAIRNG.hpp"
 #include "../map/XAIThreatMap.hpp"
+#include "../path/XAIPathFinder.hpp"
+#include "../trackers/XAIEnemySnapshot.hpp"
 
 void XAICMilitaryTaskHandler::OnEvent(const XAIIEvent* e) {
 	// make sure the base instance part
@@ -335,11 +337,13 @@ void XAICMilitaryTaskHandler::AssignIdleGroupsToTasks(std::list<XAIGroup*>* idle
 bool XAICMilitaryTaskHandler::TryAddAttackTaskForGroup(XAIGroup* group, const XAIAttackTaskListItem* item) {
 	const int attackeeUnitID = GetBestAttackeeIDForGroup(group, item);
 
-	if (attackeeUnitID == -1 || xaih->ccb->GetUnitDef(attackeeUnitID) == NULL) {
+	const int attackeeRow = xaih->enemySnapshot->GetRowIndex(attackeeUnitID);
+
+	if (attackeeRow == -1) {
 		return false;
 	}
 
-	const float3& attackeeUnitPos = xaih->ccb->GetUnitPos(attackeeUnitID);
+	const float3 attackeeUnitPos = xaih->enemySnapshot->GetUnitPos(attackeeRow);
 	const std::map<int, int>::iterator it = attackTaskCountsForUnitID.find(attackeeUnitID);
 	const int attackTaskCount = (it != attackTaskCountsForUnitID.end())? it->second: 0;
 
@@ -483,21 +487,21 @@ bool XAICMilitaryTaskHandler::TryAddLuaTaskForGroup(XAIGroup* group) {
 	sqDistMin = 1e30f;                                                                            \
                                                                                                   \
 	for (std::set<int>::const_iterator it = unitIDs.begin(); it != unitIDs.end(); it++) {         \
-		const    UnitDef* sDef = xaih->ccb->GetUnitDef(*it);                                      \
+		const int         eRow = enemies->GetRowIndex(*it);                                       \
 		const XAIUnitDef* xDef = NULL;                                                            \
                                                                                                   \
-		if (sDef == NULL)                                                                         \
+		if (eRow == -1)                                                                           \
 			continue;                                                                             \
                                                                                                   \
-		xDef = xaih->unitDefHandler->GetUnitDefByID(sDef->id);                                    \
+		xDef = xaih->unitDefHandler->GetUnitDefByID(enemies->GetUnitDefID(eRow));                 \
 		numEnemyMobileBuilders += int((xDef->typeMask & MASK_BUILDER_MOBILE) > 0);                \
 		numEnemyStaticBuilders += int((xDef->typeMask & MASK_BUILDER_STATIC) > 0);                \
                                                                                                   \
-		if (sDef->id == item->GetAttackeeDefID()) {                                               \
+		if (xDef->GetID() == item->GetAttackeeDefID()) {                                          \
 			const std::map<int, int>::iterator mit = attackTaskCountsForUnitID.find(*it);         \
 			const int attackTaskCount = (mit != attackTaskCountsForUnitID.end())? mit->second: 1; \
                                                                                                   \
-			sqDistCur = (xaih->ccb->GetUnitPos(*it) - group->GetPos()).SqLength();                \
+			sqDistCur = (enemies->GetUnitPos(eRow) - group->GetPos()).SqLength();                 \
 			sqDistCur *= attackTaskCount;                                                         \
                                                                                                   \
 			if (sqDistCur < sqDistMin) {                                                          \
@@ -510,17 +514,17 @@ bool XAICMilitaryTaskHandler::TryAddLuaTaskForGroup(XAIGroup* group) {
 	sqDistMin = 1e30f;                                                                                         \
                                                                                                                \
 	for (std::set<int>::const_iterator it = enemyUnitIDsInLOS.begin(); it != enemyUnitIDsInLOS.end(); it++) {  \
-		const UnitDef* uDef = xaih->ccb->GetUnitDef(*it);                                                      \
+		const int eRow = enemies->GetRowIndex(*it);                                                            \
 		const XAIUnitDef* xuDef = NULL;                                                                        \
                                                                                                                \
-		if (uDef == NULL)                                                                                      \
+		if (eRow == -1)                                                                                        \
 			continue;                                                                                          \
                                                                                                                \
 		const std::map<int, int>::iterator mit = attackTaskCountsForUnitID.find(*it);                          \
 		const int attackTaskCount = (mit != attackTaskCountsForUnitID.end())? mit->second: 1;                  \
                                                                                                                \
-		xuDef = xaih->unitDefHandler->GetUnitDefByID(uDef->id);                                                \
-		sqDistCur = (xaih->ccb->GetUnitPos(*it) - group->GetPos()).SqLength();                                 \
+		xuDef = xaih->unitDefHandler->GetUnitDefByID(enemies->GetUnitDefID(eRow));                             \
+		sqDistCur = (enemies->GetUnitPos(eRow) - group->GetPos()).SqLength();                                  \
 		sqDistCur *= attackTaskCount;                                                                          \
                                                                                                                \
 		if (xuDef->typeMask & MASK_OFFENSE_MOBILE   ) { sqDistCur /= 256.0f; }                                 \
@@ -546,30 +550,29 @@ bool XAICMilitaryTaskHandler::TryAddLuaTaskForGroup(XAIGroup* group) {
 
 #define SEARCH_FOR_UNKNOWN_ENEMIES_BY_DEF()                                                       \
 	sqDistMin = 1e30f;                                                                            \
+	UpdateReachableEnemyRows(group);                                                              \
                                                                                                   \
-	for (int i = xaih->threatMap->GetNumEnemies(); i >= 0; i--) {                                 \
-		const int    enemyID  = xaih->threatMap->GetEnemyID(i);                                   \
-		const float3 enemyPos = xaih->ccb->GetUnitPos(enemyID);                                   \
-                                                                                                  \
-		const    UnitDef* sDef = xaih->ccb->GetUnitDef(enemyID);                                  \
-		const XAIUnitDef* xDef = NULL;                                                            \
-                                                                                                  \
-		if (sDef == NULL)                                                                         \
-			continue;                                                                             \
+	for (int eRow = enemies->GetNumRows() - 1; eRow >= 0; eRow--) {                               \
+		const int    enemyID  = enemies->GetUnitID(eRow);                                         \
+		const int    enemyDef = enemies->GetUnitDefID(eRow);                                      \
+		const float3 enemyPos = enemies->GetUnitPos(eRow);                                        \
                                                                                                   \
-		xDef = xaih->unitDefHandler->GetUnitDefByID(sDef->id);                                    \
+		const XAIUnitDef* xDef = xaih->unitDefHandler->GetUnitDefByID(enemyDef);                  \
 		numEnemyMobileBuilders += int((xDef->typeMask & MASK_BUILDER_MOBILE) > 0);                \
 		numEnemyStaticBuilders += int((xDef->typeMask & MASK_BUILDER_STATIC) > 0);                \
                                                                                                   \
 		if (group->GetPower() < xaih->threatMap->GetThreat(enemyPos)) {                           \
 			continue;                                                                             \
+		}                                                                                         \
+		if (reachableEnemyRows[eRow] == 0) {                                                      \
+			continue;                                                                             \
 		}                                                                                         \
                                                                                                   \
-		if (sDef->id == item->GetAttackeeDefID()) {                                               \
+		if (enemyDef == item->GetAttackeeDefID()) {                                               \
 			const std::map<int, int>::iterator mit = attackTaskCountsForUnitID.find(enemyID);     \
 			const int attackTaskCount = (mit != attackTaskCountsForUnitID.end())? mit->second: 1; \
                                                                                                   \
-			sqDistCur = (xaih->ccb->GetUnitPos(enemyID) - group->GetPos()).SqLength();            \
+			sqDistCur = (enemyPos - group->GetPos()).SqLength();                                  \
 			sqDistCur *= attackTaskCount;                                                         \
                                                                                                   \
 			if (sqDistCur < sqDistMin) {                                                          \
@@ -583,26 +586,25 @@ bool XAICMilitaryTaskHandler::TryAddLuaTaskForGroup(XAIGroup* group) {
 // says minGroupSize=8 ... instead/also use {min, max}Threat?
 #define SEARCH_FOR_UNKNOWN_ENEMIES_BY_MASK()                                                  \
 	sqDistMin = 1e30f;                                                                        \
+	UpdateReachableEnemyRows(group);                                                          \
                                                                                               \
-	for (int i = xaih->threatMap->GetNumEnemies(); i >= 0; i--) {                             \
-		const int    enemyID  = xaih->threatMap->GetEnemyID(i);                               \
-		const float3 enemyPos = xaih->ccb->GetUnitPos(enemyID);                               \
+	for (int eRow = enemies->GetNumRows() - 1; eRow >= 0; eRow--) {                           \
+		const int    enemyID  = enemies->GetUnitID(eRow);                                     \
+		const int    enemyDef = enemies->GetUnitDefID(eRow);                                  \
+		const float3 enemyPos = enemies->GetUnitPos(eRow);                                    \
                                                                                               \
-		const    UnitDef* suDef = xaih->ccb->GetUnitDef(enemyID);                             \
-		const XAIUnitDef* xuDef = NULL;                                                       \
-                                                                                              \
-		if (suDef == NULL)                                                                    \
-			continue;                                                                         \
+		const XAIUnitDef* xuDef = xaih->unitDefHandler->GetUnitDefByID(enemyDef);             \
                                                                                               \
 		/* if we have a task-item restraint on this attackee, skip it */                      \
-		if (xaih->taskListsParser->HasAttackeeAttackerItem(suDef->id, gUnitDef->GetID()))     \
+		if (xaih->taskListsParser->HasAttackeeAttackerItem(enemyDef, gUnitDef->GetID()))      \
+			continue;                                                                         \
+		if (reachableEnemyRows[eRow] == 0)                                                    \
 			continue;                                                                         \
                                                                                               \
 		const std::map<int, int>::iterator mit = attackTaskCountsForUnitID.find(enemyID);     \
 		const int attackTaskCount = (mit != attackTaskCountsForUnitID.end())? mit->second: 1; \
                                                                                               \
-		xuDef = xaih->unitDefHandler->GetUnitDefByID(suDef->id);                              \
-		sqDistCur = (xaih->ccb->GetUnitPos(enemyID) - group->GetPos()).SqLength();            \
+		sqDistCur = (enemyPos - group->GetPos()).SqLength();                                  \
 		sqDistCur *= attackTaskCount;                                                         \
                                                                                               \
 		if (xuDef->typeMask & MASK_OFFENSE_MOBILE   ) { sqDistCur /= 256.0f; }                \
@@ -632,12 +634,29 @@ bool XAICMilitaryTaskHandler::TryAddLuaTaskForGroup(XAIGroup* group) {
 
 
 
+// marks the rows of the enemy snapshot whose units <group>
+// can reach, with one batched region-lookup for all of them
+void XAICMilitaryTaskHandler::UpdateReachableEnemyRows(const XAIGroup* group) {
+	const XAICEnemySnapshot* enemies = xaih->enemySnapshot;
+
+	reachableEnemyPositions.clear();
+	reachableEnemyPositions.reserve(enemies->GetNumRows());
+
+	for (int eRow = 0; eRow < enemies->GetNumRows(); eRow++) {
+		reachableEnemyPositions.push_back(enemies->GetUnitPos(eRow));
+	}
+
+	xaih->pathFinder->IsPathPossibleBatch(group, reachableEnemyPositions, &reachableEnemyRows);
+}
+
 int XAICMilitaryTaskHandler::GetBestAttackeeIDForGroup(XAIGroup* group, const XAIAttackTaskListItem* item) {
 	XAICScopedTimer t("[XAICMilitaryTaskHandler::GetBestAttackeeIDForGroup]", xaih->timer);
 
 	const XAICUnit*   gUnit    = group->GetLeadUnitMember();
 	const XAIUnitDef* gUnitDef = gUnit->GetUnitDefPtr();
 
+	const XAICEnemySnapshot* enemies = xaih->enemySnapshot;
+
 	int attackeeID = -1;
 
 	int numEnemyMobileBuilders = 0;
@@ -0,0 +1,116 @@
+#include "LegacyCpp/IAICallback.h"
+#include "LegacyCpp/IAICheats.h"
+#include "LegacyCpp/UnitDef.h"
+#include "Sim/Misc/GlobalConstants.h"
+
+#include "./XAIEnemySnapshot.hpp"
+#include "../events/XAIIEvent.hpp"
+#include "../main/XAIHelper.hpp"
+#include "../utils/XAITimer.hpp"
+
+void XAICEnemySnapshot::OnEvent(const XAIIEvent* e) {
+	switch (e->type) {
+		case XAI_EVENT_ENEMY_ENTER_LOS: {
+			const XAIEnemyEnterLOSEvent* ee = dynamic_cast<const XAIEnemyEnterLOSEvent*>(e);
+			unitVisFlags[ee->unitID] |= XAI_ENEMY_IN_LOS;
+		} break;
+		case XAI_EVENT_ENEMY_LEAVE_LOS: {
+			const XAIEnemyLeaveLOSEvent* ee = dynamic_cast<const XAIEnemyLeaveLOSEvent*>(e);
+			unitVisFlags[ee->unitID] &= ~XAI_ENEMY_IN_LOS;
+		} break;
+		case XAI_EVENT_ENEMY_ENTER_RADAR: {
+			const XAIEnemyEnterRadarEvent* ee = dynamic_cast<const XAIEnemyEnterRadarEvent*>(e);
+			unitVisFlags[ee->unitID] |= XAI_ENEMY_IN_RADAR;
+		} break;
+		case XAI_EVENT_ENEMY_LEAVE_RADAR: {
+			const XAIEnemyLeaveRadarEvent* ee = dynamic_cast<const XAIEnemyLeaveRadarEvent*>(e);
+			unitVisFlags[ee->unitID] &= ~XAI_ENEMY_IN_RADAR;
+		} break;
+		case XAI_EVENT_ENEMY_DESTROYED: {
+			const XAIEnemyDestroyedEvent* ee = dynamic_cast<const XAIEnemyDestroyedEvent*>(e);
+			unitVisFlags[ee->unitID] = 0;
+		} break;
+
+		case XAI_EVENT_INIT: {
+			Init();
+		} break;
+		case XAI_EVENT_UPDATE: {
+			Update();
+		} break;
+		case XAI_EVENT_RELEASE: {
+			numRows = 0;
+		} break;
+
+		default: {
+		} break;
+	}
+}
+
+void XAICEnemySnapshot::Init() {
+	unitIDs.resize(MAX_UNITS, -1);
+	unitDefIDs.resize(MAX_UNITS, 0);
+	posX.resize(MAX_UNITS, 0.0f);
+	posY.resize(MAX_UNITS, 0.0f);
+	posZ.resize(MAX_UNITS, 0.0f);
+	healthRatios.resize(MAX_UNITS, 0.0f);
+	visFlags.resize(MAX_UNITS, 0);
+
+	rowIndices.resize(MAX_UNITS, -1);
+	unitVisFlags.resize(MAX_UNITS, 0);
+}
+
+void XAICEnemySnapshot::Update() {
+	XAICScopedTimer t("[XAICEnemySnapshot::Update]", xaih->timer);
+
+	// forget last frame's rows
+	for (int row = 0; row < numRows; row++) {
+		rowIndices[unitIDs[row]] = -1;
+	}
+
+	// note: the IDs are fetched into the first column
+	// and compacted in-place, which is safe since rows
+	// are never written ahead of the index being read
+	const int numUnitIDs = xaih->ccb->GetEnemyUnits(&unitIDs[0], MAX_UNITS);
+
+	numRows = 0;
+
+	for (int i = 0; i < numUnitIDs; i++) {
+		const int      unitID  = unitIDs[i];
+		const UnitDef* unitDef = xaih->ccb->GetUnitDef(unitID);
+
+		if (unitDef == NULL)
+			continue;
+
+		const float3 unitPos   = xaih->ccb->GetUnitPos(unitID);
+		const float  curHealth = xaih->ccb->GetUnitHealth(unitID);
+		const float  maxHealth = xaih->ccb->GetUnitMaxHealth(unitID);
+
+		unitIDs[numRows]      = unitID;
+		unitDefIDs[numRows]   = unitDef->id;
+		posX[numRows]         = unitPos.x;
+		posY[numRows]         = unitPos.y;
+		posZ[numRows]         = unitPos.z;
+		healthRatios[numRows] = (maxHealth > 0.0f)? (curHealth / maxHealth): 1.0f;
+		visFlags[numRows]     = unitVisFlags[unitID];
+
+		rowIndices[unitID] = numRows++;
+	}
+}
+
+int XAICEnemySnapshot::GetRowsInRadius(const float3& pos, float r, std::vector<int>& rows) const {
+	const float rSq = r * r;
+
+	rows.clear();
+
+	for (int row = 0; row < numRows; row++) {
+		const float dx = posX[row] - pos.x;
+		const float dy = posY[row] - pos.y;
+		const float dz = posZ[row] - pos.z;
+
+		if (((dx * dx) + (dy * dy) + (dz * dz)) <= rSq) {
+			rows.push_back(row);
+		}
+	}
+
+	return (rows.size());
+}
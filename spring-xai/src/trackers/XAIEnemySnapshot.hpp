@@ -0,0 +1,70 @@
+#ifndef XAI_ENEMYSNAPSHOT_HDR
+#define XAI_ENEMYSNAPSHOT_HDR
+
+#include <vector>
+
+#include "System/float3.h"
+#include "../events/XAIIEventReceiver.hpp"
+
+enum XAIEnemyVisibilityFlags {
+	XAI_ENEMY_IN_LOS   = 1,
+	XAI_ENEMY_IN_RADAR = 2,
+};
+
+// per-frame copy of everything the AI needs to know about
+// enemy units, filled once (right after GetEnemyUnits) so
+// that consumers do not each query the cheat-callback for
+// the same data; rows are only valid during one frame and
+// only contain enemies whose UnitDef could be retrieved
+struct XAIIEvent;
+struct XAIHelper;
+class XAICEnemySnapshot: public XAIIEventReceiver {
+public:
+	XAICEnemySnapshot(XAIHelper* h): numRows(0), xaih(h) {}
+	void OnEvent(const XAIIEvent*);
+
+	int GetNumRows() const { return numRows; }
+	// returns -1 if the unit is not part of the snapshot
+	int GetRowIndex(int unitID) const {
+		if (unitID < 0 || unitID >= int(rowIndices.size()))
+			return -1;
+		return rowIndices[unitID];
+	}
+
+	int GetUnitID(int row) const { return unitIDs[row]; }
+	int GetUnitDefID(int row) const { return unitDefIDs[row]; }
+	float3 GetUnitPos(int row) const { return float3(posX[row], posY[row], posZ[row]); }
+	float GetHealthRatio(int row) const { return healthRatios[row]; }
+
+	bool IsInLOS(int row) const { return ((visFlags[row] & XAI_ENEMY_IN_LOS) != 0); }
+	bool IsInRadar(int row) const { return ((visFlags[row] & XAI_ENEMY_IN_RADAR) != 0); }
+
+	// fills <rows> with the rows of all enemies within
+	// <r> elmos of <pos>, returns the number of rows
+	int GetRowsInRadius(const float3& pos, float r, std::vector<int>& rows) const;
+
+private:
+	void Init();
+	void Update();
+
+	int numRows;
+
+	// the table; all columns have MAX_UNITS entries
+	std::vector<int> unitIDs;
+	std::vector<int> unitDefIDs;
+	std::vector<float> posX;
+	std::vector<float> posY;
+	std::vector<float> posZ;
+	std::vector<float> healthRatios;
+	std::vector<unsigned char> visFlags;
+
+	// unitID to row (or -1), reset every frame
+	std::vector<int> rowIndices;
+	// visibility flags by unitID, maintained via the
+	// LOS and radar events and copied into each row
+	std::vector<unsigned char> unitVisFlags;
+
+	XAIHelper* xaih;
+};
+
+#endif
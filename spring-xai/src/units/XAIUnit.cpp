@@ -69,11 +69,11 @@ void XAICUnit::UpdatePosition() {
 	dir = (vel != ZeroVector)? (vel / vel.Length()): ZeroVector;
 	spd = (limboTime == 0)? (vel.Length() * GAME_SPEED): 0.0f;
 
-	// the unit-handler updates *after* the threat-map does,
-	// so the threat-values of enemy units are already known
-	// and we can decrease them by those of our own units
+	// our own attackers offset the enemy threat-values via
+	// the threat-map's influence layer, which only has to be
+	// re-stamped when we have moved into another cell
 	if (unitDef->isAttacker && unitDef->maxWeaponRange > 0.0f) {
-		xaih->threatMap->AddThreatExt(pos, unitDef->maxWeaponRange * 1.25f, -unitDef->GetPower());
+		xaih->threatMap->SetInfluence(id, pos, unitDef->maxWeaponRange * 1.25f, unitDef->GetPower());
 	}
 }
 
@@ -8,11 +8,13 @@
 #include "./XAIUnitDGunController.hpp"
 #include "./XAIUnitHandler.hpp"
 #include "./XAIUnitDef.hpp"
+#include "./XAIUnitDefHandler.hpp"
 #include "../main/XAIHelper.hpp"
+#include "../trackers/XAIEnemySnapshot.hpp"
 #include "../commands/XAICommand.hpp"
 
 XAICUnitDGunController::XAICUnitDGunController(XAIHelper* h, int id, const WeaponDef* wd): ownerID(id), ownerWD(wd), xaih(h) {
-	enemyUnitsByID.resize(MAX_UNITS, 0);
+	enemyUnitRows.reserve(MAX_UNITS);
 
 	// set the owner unit to hold fire (we need this since
 	// FAW and RF interfere with dgun and reclaim orders)
@@ -39,9 +41,15 @@ void XAICUnitDGunController::EnemyDestroyed(int attackerID, int targetID) {
 void XAICUnitDGunController::TrackAttackTarget(unsigned int currentFrame) {
 	if (currentFrame - state.targetSelectionFrame == 5) {
 		// five sim-frames have passed since selecting target, attack
-		const UnitDef* udef = xaih->ccb->GetUnitDef(state.targetID);
+		const XAICEnemySnapshot* enemies = xaih->enemySnapshot;
 
-		const float3 curTargetPos = xaih->ccb->GetUnitPos(state.targetID);        // current target position
+		const int         targetRow = enemies->GetRowIndex(state.targetID);
+		const XAIUnitDef* targetDef = (targetRow != -1)? xaih->unitDefHandler->GetUnitDefByID(enemies->GetUnitDefID(targetRow)): NULL;
+		const UnitDef*    udef      = (targetDef != NULL)? targetDef->GetDef(): NULL;
+
+		// current target position (a target that died since
+		// it was selected is no longer part of the snapshot)
+		const float3 curTargetPos = (targetRow != -1)? enemies->GetUnitPos(targetRow): ZeroVector;
 		const float3 curOwnerPos  = xaih->ccb->GetUnitPos(ownerID);               // current owner position
 
 		const float3 targetDif    = (curOwnerPos - curTargetPos);
@@ -97,7 +105,7 @@ void XAICUnitDGunController::TrackAttackTarget(unsigned int currentFrame) {
 					IssueOrder(state.targetID, commandID = CMD_CAPTURE, 0);
 				}
 			} else {
-				if (xaih->ccb->GetUnitHealth(state.targetID) < xaih->ccb->GetUnitMaxHealth(state.targetID) * 0.5f) {
+				if (targetRow != -1 && enemies->GetHealthRatio(targetRow) < 0.5f) {
 					IssueOrder(state.targetID, commandID = CMD_RECLAIM, 0);
 				} else {
 					IssueOrder(state.targetID, commandID = CMD_CAPTURE, 0);
@@ -123,30 +131,33 @@ void XAICUnitDGunController::SelectTarget(unsigned int currentFrame) {
 		return;
 	}
 
+	const XAICEnemySnapshot* enemies = xaih->enemySnapshot;
+
 	// get all units within immediate (non-walking) dgun range
 	const float maxRange = xaih->rcb->GetUnitMaxRange(ownerID);
-	const int   numUnits = xaih->ccb->GetEnemyUnits(&enemyUnitsByID[0], ownerPos, maxRange * 0.9f);
+	const int   numUnits = enemies->GetRowsInRadius(ownerPos, maxRange * 0.9f, enemyUnitRows);
 
 	for (int i = 0; i < numUnits; i++) {
-		const int enemyUnitID = enemyUnitsByID[i];
+		const int enemyRow    = enemyUnitRows[i];
+		const int enemyUnitID = enemies->GetUnitID(enemyRow);
 
 		if (enemyUnitID <= 0) {
 			continue;
 		}
 
-		if (xaih->ccb->GetUnitHealth(enemyUnitID) <= 0.0f) {
+		// check if unit still alive (needed since units that
+		// were destroyed this frame can still be in the snapshot)
+		if (enemies->GetHealthRatio(enemyRow) <= 0.0f) {
 			continue;
 		}
 
-		// check if unit still alive (needed since when UnitDestroyed()
-		// triggered GetEnemyUnits() is not immediately updated as well)
-		const UnitDef* enemyUnitDef = xaih->ccb->GetUnitDef(enemyUnitID);
+		const UnitDef* enemyUnitDef = (xaih->unitDefHandler->GetUnitDefByID(enemies->GetUnitDefID(enemyRow)))->GetDef();
 
 		// don't directly pop enemy commanders
 		if (enemyUnitDef && !enemyUnitDef->isCommander && !enemyUnitDef->canDGun) {
 			state.targetSelectionFrame = currentFrame;
 			state.targetID             = enemyUnitID;
-			state.oldTargetPos         = xaih->ccb->GetUnitPos(enemyUnitID);
+			state.oldTargetPos         = enemies->GetUnitPos(enemyRow);
 			return;
 		}
 	}
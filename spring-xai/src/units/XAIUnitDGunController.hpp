@@ -72,7 +72,7 @@ private:
 	const int        ownerID;
 	const WeaponDef* ownerWD;
 
-	std::vector<int> enemyUnitsByID;
+	std::vector<int> enemyUnitRows;
 	ControllerState state;
 
 	XAIHelper* xaih;
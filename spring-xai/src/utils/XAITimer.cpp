@@ -101,4 +101,21 @@ void XAICTimer::WriteLog() {
 		log << std::endl;
 		log.flush();
 	}
+
+	if (mcounters.empty()) {
+		return;
+	}
+
+	log << std::endl;
+	log << "absolute and per-frame values per counter:" << std::endl;
+	log.flush();
+
+	for (std::map<std::string, unsigned int>::const_iterator it = mcounters.begin(); it != mcounters.end(); it++) {
+		log << "\t";
+		log << it->first << "\t";
+		log << it->second << "\t";
+		log << (it->second / double(logFrame));
+		log << std::endl;
+		log.flush();
+	}
 }
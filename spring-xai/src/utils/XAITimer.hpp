@@ -37,10 +37,14 @@ public:
 	}
 
 	unsigned int GetTaskTime(const std::string& t);
+	// event-counters (eg. cache hits) listed in the log
+	// after the timings, set by their owners when done
+	void SetCounter(const std::string& c, unsigned int n) { mcounters[c] = n; }
 	void WriteLog();
 
 	std::map<std::string, unsigned int> mtimings;
 	std::map<std::string, unsigned int> mcounts;
+	std::map<std::string, unsigned int> mcounters;
 	std::vector<XAICScopedTimer::TimingDatum> vtimings;
 
 	unsigned int timerDepth;      // depth of the most recent ScopedTimer
@@ -66,6 +66,16 @@ namespace XAIUtil {
 		return c;
 	}
 
+	unsigned int HashBytes(unsigned int h, const void* p, unsigned int n) {
+		const unsigned char* bytes = (const unsigned char*) p;
+
+		for (unsigned int i = 0; i < n; i++) {
+			h = (h ^ bytes[i]) * 16777619u;
+		}
+
+		return h;
+	}
+
 	#ifdef BUILDING_AI
 	// one MoveData instance is more restrictive than
 	// another if, all other properties being less or
@@ -2,6 +2,10 @@
 #define XAI_UTIL_HDR
 
 #include <set>
+#include <string>
+
+// initial value for XAIUtil::HashBytes
+#define XAI_HASH_SEED 2166136261u
 
 struct MoveData;
 class float3;
@@ -36,6 +40,8 @@ namespace XAIUtil {
 	}
 
 	unsigned int CountOneBits(unsigned int);
+	// FNV-1a hash of <n> bytes, continuing from <h>
+	unsigned int HashBytes(unsigned int h, const void*, unsigned int n);
 
 	// const MoveData* MostRestrictiveMoveDataIns(const MoveData*, const MoveData*);
 